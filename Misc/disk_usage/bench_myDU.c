@@ -0,0 +1,251 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Times the myDU binary with its default fork-per-top-level-directory walk
+// against the -j work-stealing thread pool on generated trees:
+//   balanced - every top-level directory holds the same subtree
+//   deep     - one top-level directory holds a binary tree DEEP_LEVELS deep
+//   wide     - one top-level directory holds WIDE_DIRS subdirectories
+// The other top-level directories of the skewed trees hold one file each,
+// so the fork model leaves all but one child idle. Both walks must print
+// the same total. The page cache is warm after the first run, so this
+// measures traversal and stat overhead, not the disk.
+//
+// gcc -O2 bench_myDU.c -o bench_myDU
+// ./bench_myDU ./myDU [threads] [runs]
+
+#define TOP_DIRS 8
+#define FILES_PER_DIR 8
+#define DEEP_LEVELS 11
+#define WIDE_DIRS 4096
+#define BALANCED_FANOUT 4
+#define BALANCED_LEVELS 4
+
+void MakeDir(const char *path)
+{
+	if (mkdir(path, 0755) == -1)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+}
+
+// path = dir/<prefix><i>
+void EntryPath(char *path, const char *dir, const char *prefix, int i)
+{
+	if (snprintf(path, PATH_MAX, "%s/%s%d", dir, prefix, i) >= PATH_MAX)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+}
+
+void MakeFiles(const char *dir, int count)
+{
+	char path[PATH_MAX];
+	static char data[4096];
+
+	for (int i = 0; i < count; i++)
+	{
+		EntryPath(path, dir, "f", i);
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || write(fd, data, 64 + 512 * (i % 8)) < 0)
+		{
+			perror("Unable to execute\n");
+			exit(1);
+		}
+		close(fd);
+	}
+}
+
+// fanout subdirectories per level, levels deep, files in every directory
+void MakeTree(const char *dir, int fanout, int levels)
+{
+	char path[PATH_MAX];
+
+	MakeFiles(dir, FILES_PER_DIR);
+	if (levels == 0)
+		return;
+
+	for (int i = 0; i < fanout; i++)
+	{
+		EntryPath(path, dir, "d", i);
+		MakeDir(path);
+		MakeTree(path, fanout, levels - 1);
+	}
+}
+
+void MakeShape(const char *root, const char *shape)
+{
+	char path[PATH_MAX];
+
+	MakeDir(root);
+	for (int t = 0; t < TOP_DIRS; t++)
+	{
+		EntryPath(path, root, "top", t);
+		MakeDir(path);
+
+		if (strcmp(shape, "balanced") == 0)
+			MakeTree(path, BALANCED_FANOUT, BALANCED_LEVELS);
+		else if (t > 0)
+			MakeFiles(path, 1);
+		else if (strcmp(shape, "deep") == 0)
+			MakeTree(path, 2, DEEP_LEVELS);
+		else
+		{
+			char sub[PATH_MAX];
+
+			MakeFiles(path, FILES_PER_DIR);
+			for (int i = 0; i < WIDE_DIRS; i++)
+			{
+				EntryPath(sub, path, "w", i);
+				MakeDir(sub);
+				MakeFiles(sub, FILES_PER_DIR);
+			}
+		}
+	}
+}
+
+int RemoveEntry(const char *path, const struct stat *s, int flag, struct FTW *ftw)
+{
+	(void)s;
+	(void)flag;
+	(void)ftw;
+	return remove(path);
+}
+
+double Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Runs myDU with its output on a pipe; returns the wall time and stores
+// the printed total.
+double RunDU(char *du, char *jobs, char *dir, long long *total)
+{
+	int fds[2];
+	if (pipe(fds) == -1)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	double start = Now();
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	if (pid == 0)
+	{
+		dup2(fds[1], 1);
+		close(fds[0]);
+		close(fds[1]);
+		if (jobs)
+			execl(du, du, "-j", jobs, dir, (char *)NULL);
+		else
+			execl(du, du, dir, (char *)NULL);
+		perror("Unable to execute\n");
+		_exit(1);
+	}
+
+	close(fds[1]);
+	char out[64];
+	int len = 0, n;
+	while ((n = read(fds[0], out + len, sizeof(out) - 1 - len)) > 0)
+		len += n;
+	close(fds[0]);
+	out[len] = '\0';
+
+	int status;
+	waitpid(pid, &status, 0);
+	double elapsed = Now() - start;
+
+	if (len == 0)
+	{
+		fprintf(stderr, "%s printed nothing\n", du);
+		exit(1);
+	}
+	*total = atoll(out);
+	return elapsed;
+}
+
+int CompareDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+double Median(char *du, char *jobs, char *dir, int runs, long long *total)
+{
+	double times[runs];
+
+	for (int r = 0; r < runs; r++)
+		times[r] = RunDU(du, jobs, dir, total);
+	qsort(times, runs, sizeof(double), CompareDouble);
+	return times[runs / 2];
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s ./myDU [threads] [runs]\n", argv[0]);
+		exit(1);
+	}
+
+	char *du = argv[1];
+	char *jobs = argc > 2 ? argv[2] : "8";
+	int runs = argc > 3 ? atoi(argv[3]) : 5;
+	if (atoi(jobs) <= 0 || runs <= 0)
+	{
+		fprintf(stderr, "usage: %s ./myDU [threads] [runs]\n", argv[0]);
+		exit(1);
+	}
+
+	char base[] = "/tmp/bench_myDU.XXXXXX";
+	if (mkdtemp(base) == NULL)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	const char *shapes[] = { "balanced", "deep", "wide" };
+
+	printf("%-10s %12s %12s %8s\n", "tree", "fork ms", "-j ms", "speedup");
+	for (int i = 0; i < 3; i++)
+	{
+		char root[PATH_MAX];
+		snprintf(root, sizeof(root), "%s/%s", base, shapes[i]);
+		MakeShape(root, shapes[i]);
+
+		long long fork_total, pool_total;
+		RunDU(du, NULL, root, &fork_total);
+		double fork_time = Median(du, NULL, root, runs, &fork_total);
+		double pool_time = Median(du, jobs, root, runs, &pool_total);
+
+		if (fork_total != pool_total)
+		{
+			fprintf(stderr, "%s: totals differ (%lld vs %lld)\n", shapes[i], fork_total, pool_total);
+			exit(1);
+		}
+
+		printf("%-10s %12.2f %12.2f %8.2f\n", shapes[i], fork_time * 1e3, pool_time * 1e3, fork_time / pool_time);
+	}
+
+	nftw(base, RemoveEntry, 64, FTW_DEPTH | FTW_PHYS);
+	return 0;
+}
@@ -1,144 +1,1568 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
 #include <fcntl.h>
 #include <string.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fnmatch.h>
+#include <getopt.h>
 
-long long int SizeCalc(char* dir, int level){
+// -G: list directories with bulk getdents64 reads and trust d_type
+int use_getdents;
+// -U: stat entries in batches through io_uring
+int use_uring;
+// -B: count allocated blocks instead of apparent file sizes
+int count_blocks;
+// -H: count every (device, inode) once, so hard links and revisited
+// directories add nothing the second time
+int dedupe_links;
+// -C file: reuse per-directory totals saved by an earlier run
+char *cache_file;
+// -d: print every directory's total as soon as its subtree is done
+int print_dirs;
+// -t N: report the N largest directories and files after the walk
+int top_n;
+// --max-depth N: do not open directories more than N levels below the root
+int max_depth = -1;
+// -x: do not cross into directories on another device than the root
+int one_file_system;
+dev_t root_dev;
+// --exclude PATTERN: skip matching entries without stat'ing or opening them
+char **excludes;
+int num_excludes;
+unsigned int exclude_hash;
+
+///////////////////////////////////////////////////////////////////////
+////////////////////////// Directory reading //////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+#define DENTS_BUF_SIZE (64 * 1024)
+
+struct linux_dirent64
+{
+	unsigned long d_ino;
+	long d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+// Iterates the entries of an open directory fd, either through readdir()
+// or, with -G, through raw getdents64() into a 64 KiB buffer.
+struct DirReader
+{
+	DIR *dp;
+	int fd;
+	char *buf;
+	long pos;
+	long len;
+};
+
+void OpenDirReader(struct DirReader *dr, int fd)
+{
+	dr->fd = fd;
+	dr->dp = NULL;
+	dr->buf = NULL;
+	dr->pos = 0;
+	dr->len = 0;
+
+	if (use_getdents)
+		dr->buf = malloc(DENTS_BUF_SIZE);
+	else
+		dr->dp = fdopendir(fd);
+
+	if (dr->buf == NULL && dr->dp == NULL)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+}
+
+// Returns 0 and fills name/type for the next entry, -1 at the end.
+int NextEntry(struct DirReader *dr, const char **name, unsigned char *type)
+{
+	if (dr->dp)
+	{
+		struct dirent *d = readdir(dr->dp);
+		if (d == NULL)
+			return -1;
+		*name = d->d_name;
+		*type = d->d_type;
+		return 0;
+	}
+
+	if (dr->pos >= dr->len)
+	{
+		dr->len = syscall(SYS_getdents64, dr->fd, dr->buf, DENTS_BUF_SIZE);
+		if (dr->len < 0)
+		{
+			perror("Unable to execute\n");
+			exit(1);
+		}
+		dr->pos = 0;
+		if (dr->len == 0)
+			return -1;
+	}
+
+	struct linux_dirent64 *d = (struct linux_dirent64 *)(dr->buf + dr->pos);
+	dr->pos += d->d_reclen;
+	*name = d->d_name;
+	*type = d->d_type;
+	return 0;
+}
+
+void CloseDirReader(struct DirReader *dr)
+{
+	if (dr->dp)
+		closedir(dr->dp);
+	else
+	{
+		close(dr->fd);
+		free(dr->buf);
+	}
+}
+
+char *JoinPath(const char *dir, const char *name)
+{
+	int len1 = strlen(dir);
+	int len2 = strlen(name);
+	char *file_path = malloc(len1 + len2 + 2);
+	if (file_path == NULL)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	memcpy(file_path, dir, len1);
+	file_path[len1] = '/';
+	memcpy(file_path + len1 + 1, name, len2 + 1);
+	return file_path;
+}
+
+///////////////////////////////////////////////////////////////////////
+////////////////////////////// Inode set //////////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+// Inodes already counted under -H. There is one open-addressing table of
+// bare inode numbers per device, so a slot is a single 8-byte word; 0 marks
+// an empty slot and inode 0 is tracked separately. Only files with more
+// than one link (and directories) are ever inserted.
+
+struct InodeSet
+{
+	dev_t dev;
+	unsigned long *slots;
+	unsigned long cap;
+	unsigned long count;
+	int has_zero;
+	struct InodeSet *next;
+};
+
+struct InodeSet *inode_sets;
+pthread_mutex_t inode_lock = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned long HashIno(unsigned long ino)
+{
+	ino ^= ino >> 33;
+	ino *= 0xff51afd7ed558ccdUL;
+	ino ^= ino >> 33;
+	ino *= 0xc4ceb9fe1a85ec53UL;
+	ino ^= ino >> 33;
+	return ino;
+}
+
+void InodeSetGrow(struct InodeSet *set)
+{
+	unsigned long old_cap = set->cap;
+	unsigned long *old_slots = set->slots;
+
+	set->cap = old_cap ? old_cap * 2 : 1024;
+	set->slots = calloc(set->cap, sizeof(unsigned long));
+	if (set->slots == NULL)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	for (unsigned long i = 0; i < old_cap; i++)
+	{
+		if (old_slots[i] == 0)
+			continue;
+		unsigned long h = HashIno(old_slots[i]) & (set->cap - 1);
+		while (set->slots[h])
+			h = (h + 1) & (set->cap - 1);
+		set->slots[h] = old_slots[i];
+	}
+	free(old_slots);
+}
+
+// Returns 1 the first time (dev, ino) is seen and 0 afterwards.
+int InodeFirstSeen(dev_t dev, ino_t ino)
+{
+	int first = 1;
+
+	pthread_mutex_lock(&inode_lock);
+
+	struct InodeSet *set = inode_sets;
+	while (set && set->dev != dev)
+		set = set->next;
+
+	if (set == NULL)
+	{
+		set = calloc(1, sizeof(struct InodeSet));
+		if (set == NULL)
+		{
+			perror("Unable to execute\n");
+			exit(1);
+		}
+		set->dev = dev;
+		set->next = inode_sets;
+		inode_sets = set;
+	}
+
+	if (ino == 0)
+	{
+		first = !set->has_zero;
+		set->has_zero = 1;
+	}
+	else
+	{
+		// keep the load factor at or below 3/4
+		if ((set->count + 1) * 4 > set->cap * 3)
+			InodeSetGrow(set);
+
+		unsigned long h = HashIno(ino) & (set->cap - 1);
+		while (set->slots[h] && set->slots[h] != ino)
+			h = (h + 1) & (set->cap - 1);
+
+		if (set->slots[h] == ino)
+			first = 0;
+		else
+		{
+			set->slots[h] = ino;
+			set->count++;
+		}
+	}
+
+	pthread_mutex_unlock(&inode_lock);
+	return first;
+}
+
+///////////////////////////////////////////////////////////////////////
+//////////////////////// io_uring statx batching //////////////////////
+///////////////////////////////////////////////////////////////////////
+
+// With -U the entries of a directory that need a stat are queued and sent
+// to the kernel as one batch of IORING_OP_STATX requests, so the latency of
+// slow metadata lookups overlaps instead of adding up. Each thread (and
+// each forked child) sets up its own ring; if that fails, or the kernel
+// rejects the opcode, entries fall back to a synchronous fstatat().
+
+#define URING_DEPTH 64
+
+struct Uring
+{
+	int fd;
+	pid_t pid;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+struct StatBatch
+{
+	int count;
+	char names[URING_DEPTH][NAME_MAX + 1];
+	struct statx stx[URING_DEPTH];
+	int res[URING_DEPTH];
+};
+
+__thread struct Uring thread_ring;
+
+int UringSetup(struct Uring *r)
+{
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+
+	r->fd = syscall(__NR_io_uring_setup, URING_DEPTH, &p);
+	if (r->fd < 0)
+		return -1;
+
+	size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) && cq_len > sq_len)
+		sq_len = cq_len;
+
+	char *sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	char *cq = sq;
+	if (sq != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP))
+		cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+
+	if (sq == MAP_FAILED || cq == MAP_FAILED || r->sqes == MAP_FAILED)
+	{
+		close(r->fd);
+		r->fd = -1;
+		return -1;
+	}
+
+	r->sq_head = (unsigned *)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(sq + p.sq_off.array);
+	r->cq_head = (unsigned *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+}
+
+// The calling thread's ring, or NULL when io_uring is unusable here.
+struct Uring *GetRing(void)
+{
+	struct Uring *r = &thread_ring;
+
+	// a ring inherited across fork() belongs to the parent
+	if (r->pid != getpid())
+	{
+		r->pid = getpid();
+		if (UringSetup(r) < 0)
+			r->fd = -1;
+	}
+
+	return r->fd < 0 ? NULL : r;
+}
+
+// Stats every queued name relative to dfd, filling batch->res with 0 or a
+// negative errno per entry.
+void SubmitBatch(struct Uring *r, struct StatBatch *batch, int dfd)
+{
+	unsigned tail = *r->sq_tail;
+
+	for (int i = 0; i < batch->count; i++)
+	{
+		unsigned idx = tail & *r->sq_mask;
+		struct io_uring_sqe *sqe = &r->sqes[idx];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = dfd;
+		sqe->addr = (unsigned long)batch->names[i];
+		sqe->len = STATX_TYPE | STATX_SIZE | STATX_BLOCKS | STATX_INO;
+		sqe->off = (unsigned long)&batch->stx[i];
+		sqe->user_data = i;
+		r->sq_array[idx] = idx;
+		tail++;
+	}
+	__atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+
+	int submitted = 0;
+	int reaped = 0;
+
+	while (reaped < batch->count)
+	{
+		int ret = syscall(__NR_io_uring_enter, r->fd, batch->count - submitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("Unable to execute\n");
+			exit(1);
+		}
+		submitted += ret;
+
+		unsigned head = *r->cq_head;
+		while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+		{
+			struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+			batch->res[cqe->user_data] = cqe->res;
+			head++;
+			reaped++;
+		}
+		__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+////////////////////////// Breakdown output ///////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+// -d lines are gathered in a buffer that only ever holds whole lines and
+// is emptied with a single write(), so output from concurrent threads or
+// forked children never interleaves mid-line.
+
+#define OUT_BUF_SIZE (64 * 1024)
+
+char out_buf[OUT_BUF_SIZE];
+int out_len;
+pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void OutWrite(const char *buf, int len)
+{
+	while (len > 0)
+	{
+		int ret = write(STDOUT_FILENO, buf, len);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("Unable to execute\n");
+			exit(1);
+		}
+		buf += ret;
+		len -= ret;
+	}
+}
+
+void OutFlush(void)
+{
+	pthread_mutex_lock(&out_lock);
+	OutWrite(out_buf, out_len);
+	out_len = 0;
+	pthread_mutex_unlock(&out_lock);
+}
+
+void OutLine(long long bytes, const char *path)
+{
+	char num_str[24];
+	int len1 = sprintf(num_str, "%lld\t", bytes);
+	int len2 = strlen(path);
+
+	pthread_mutex_lock(&out_lock);
+	if (out_len + len1 + len2 + 1 > OUT_BUF_SIZE)
+	{
+		OutWrite(out_buf, out_len);
+		out_len = 0;
+	}
+
+	if (len1 + len2 + 1 > OUT_BUF_SIZE)
+	{
+		// longer than the whole buffer; emit it piecewise
+		OutWrite(num_str, len1);
+		OutWrite(path, len2);
+		OutWrite("\n", 1);
+	}
+	else
+	{
+		memcpy(out_buf + out_len, num_str, len1);
+		memcpy(out_buf + out_len + len1, path, len2);
+		out_buf[out_len + len1 + len2] = '\n';
+		out_len += len1 + len2 + 1;
+	}
+	pthread_mutex_unlock(&out_lock);
+}
+
+// The N largest entries seen so far, as a min-heap on bytes so the
+// smallest one is replaced first. floor caches the heap minimum once it is
+// full, letting most files be rejected without taking the lock.
+struct Heavy
+{
+	long long bytes;
+	char *path;
+};
+
+struct TopN
+{
+	struct Heavy *items;
+	int count;
+	long long floor;
+	pthread_mutex_t lock;
+};
+
+struct TopN top_dirs = { NULL, 0, -1, PTHREAD_MUTEX_INITIALIZER };
+struct TopN top_files = { NULL, 0, -1, PTHREAD_MUTEX_INITIALIZER };
+
+void HeapDown(struct TopN *t, int i)
+{
+	while (1)
+	{
+		int min = i;
+		int l = 2 * i + 1;
+		int r = 2 * i + 2;
+
+		if (l < t->count && t->items[l].bytes < t->items[min].bytes)
+			min = l;
+		if (r < t->count && t->items[r].bytes < t->items[min].bytes)
+			min = r;
+		if (min == i)
+			return;
+
+		struct Heavy tmp = t->items[i];
+		t->items[i] = t->items[min];
+		t->items[min] = tmp;
+		i = min;
+	}
+}
+
+void HeapUp(struct TopN *t, int i)
+{
+	while (i > 0 && t->items[(i - 1) / 2].bytes > t->items[i].bytes)
+	{
+		struct Heavy tmp = t->items[i];
+		t->items[i] = t->items[(i - 1) / 2];
+		t->items[(i - 1) / 2] = tmp;
+		i = (i - 1) / 2;
+	}
+}
+
+// Offers dir/name (or just dir when name is NULL) to the heap.
+void TopAdd(struct TopN *t, long long bytes, const char *dir, const char *name)
+{
+	if (bytes <= __atomic_load_n(&t->floor, __ATOMIC_RELAXED))
+		return;
+
+	char *path = name ? JoinPath(dir, name) : strdup(dir);
+	if (path == NULL)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	pthread_mutex_lock(&t->lock);
+	if (t->items == NULL)
+	{
+		t->items = malloc(top_n * sizeof(struct Heavy));
+		if (t->items == NULL)
+		{
+			perror("Unable to execute\n");
+			exit(1);
+		}
+	}
+
+	if (t->count < top_n)
+	{
+		t->items[t->count].bytes = bytes;
+		t->items[t->count].path = path;
+		HeapUp(t, t->count++);
+		path = NULL;
+	}
+	else if (bytes > t->items[0].bytes)
+	{
+		char *old = t->items[0].path;
+		t->items[0].bytes = bytes;
+		t->items[0].path = path;
+		HeapDown(t, 0);
+		path = old;
+	}
+
+	if (t->count == top_n)
+		__atomic_store_n(&t->floor, t->items[0].bytes, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&t->lock);
+
+	free(path);
+}
+
+int CompareHeavy(const void *a, const void *b)
+{
+	const struct Heavy *x = a;
+	const struct Heavy *y = b;
+
+	if (x->bytes != y->bytes)
+		return x->bytes > y->bytes ? -1 : 1;
+	return strcmp(x->path, y->path);
+}
+
+void PrintTop(struct TopN *t, const char *what)
+{
+	qsort(t->items, t->count, sizeof(struct Heavy), CompareHeavy);
+
+	printf("--- %d largest %s ---\n", t->count, what);
+	for (int i = 0; i < t->count; i++)
+	{
+		printf("%lld\t%s\n", t->items[i].bytes, t->items[i].path);
+		free(t->items[i].path);
+	}
+	free(t->items);
+}
+
+// Called once per directory with its complete subtree total.
+void DirDone(const char *path, long long total)
+{
+	if (print_dirs)
+		OutLine(total, path);
+	if (top_n)
+		TopAdd(&top_dirs, total, path, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////
+///////////////////////////// Size cache //////////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+// The -C cache file is a header followed by fixed-size records sorted by
+// (dev, ino, path hash), so a run maps it read-only and binary-searches
+// it in place. A record holds a directory's own bytes: its inode plus the
+// regular files directly in it. When the directory's mtime and path still
+// match, those files are not stat'ed again; subdirectories are still
+// listed and checked individually. In-place writes to a file do not change its directory's
+// mtime, so such growth is only picked up once the cache entry is stale.
+
+#define CACHE_MAGIC 0x484341435544594dUL
+#define CACHE_VERSION 1
+
+struct CacheHeader
+{
+	unsigned long magic;
+	unsigned int version;
+	unsigned int flags;
+	unsigned long count;
+};
+
+struct CacheRecord
+{
+	unsigned long dev;
+	unsigned long ino;
+	long mtime_sec;
+	long mtime_nsec;
+	unsigned long path_hash;
+	long long own;
+};
+
+struct CacheRecord *cache_old;
+unsigned long cache_old_count;
+struct CacheRecord *cache_new;
+unsigned long cache_new_count;
+unsigned long cache_new_cap;
+pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned int CacheFlags(void)
+{
+	// excluded files change a directory's own bytes
+	return count_blocks | dedupe_links << 1 | exclude_hash << 2;
+}
+
+unsigned long HashPath(const char *path)
+{
+	unsigned long h = 0xcbf29ce484222325UL;
+	while (*path)
+	{
+		h ^= (unsigned char)*path++;
+		h *= 0x100000001b3UL;
+	}
+	return h;
+}
+
+int CompareRecords(const void *a, const void *b)
+{
+	const struct CacheRecord *x = a;
+	const struct CacheRecord *y = b;
+
+	if (x->dev != y->dev)
+		return x->dev < y->dev ? -1 : 1;
+	if (x->ino != y->ino)
+		return x->ino < y->ino ? -1 : 1;
+	if (x->path_hash != y->path_hash)
+		return x->path_hash < y->path_hash ? -1 : 1;
+	return 0;
+}
+
+// Maps an existing cache file. A missing, foreign or mismatched file is
+// simply ignored and rewritten at the end of the run. Under -H every file
+// has to be seen to dedupe links, and under -t to rank it, so nothing is
+// reused.
+void CacheLoad(void)
+{
+	if (dedupe_links || top_n)
+		return;
+
+	int fd = open(cache_file, O_RDONLY);
+	if (fd < 0)
+		return;
+
+	struct stat s;
+	if (fstat(fd, &s) == -1 || s.st_size < (long)sizeof(struct CacheHeader))
+	{
+		close(fd);
+		return;
+	}
+
+	char *map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return;
+
+	struct CacheHeader *hdr = (struct CacheHeader *)map;
+	if (hdr->magic != CACHE_MAGIC || hdr->version != CACHE_VERSION || hdr->flags != CacheFlags() ||
+		hdr->count > (s.st_size - sizeof(struct CacheHeader)) / sizeof(struct CacheRecord))
+	{
+		munmap(map, s.st_size);
+		return;
+	}
+
+	cache_old = (struct CacheRecord *)(map + sizeof(struct CacheHeader));
+	cache_old_count = hdr->count;
+}
+
+struct CacheRecord *CacheLookup(struct stat *s, const char *path)
+{
+	struct CacheRecord key;
+	key.dev = s->st_dev;
+	key.ino = s->st_ino;
+	key.path_hash = HashPath(path);
+
+	struct CacheRecord *rec = bsearch(&key, cache_old, cache_old_count, sizeof(struct CacheRecord), CompareRecords);
+	if (rec == NULL)
+		return NULL;
+
+	if (rec->mtime_sec != s->st_mtim.tv_sec || rec->mtime_nsec != s->st_mtim.tv_nsec)
+		return NULL;
+	return rec;
+}
+
+void CacheAdd(struct stat *s, const char *path, long long own)
+{
+	pthread_mutex_lock(&cache_lock);
+
+	if (cache_new_count == cache_new_cap)
+	{
+		cache_new_cap = cache_new_cap ? cache_new_cap * 2 : 1024;
+		cache_new = realloc(cache_new, cache_new_cap * sizeof(struct CacheRecord));
+		if (cache_new == NULL)
+		{
+			perror("Unable to execute\n");
+			exit(1);
+		}
+	}
+
+	struct CacheRecord *rec = &cache_new[cache_new_count++];
+	rec->dev = s->st_dev;
+	rec->ino = s->st_ino;
+	rec->mtime_sec = s->st_mtim.tv_sec;
+	rec->mtime_nsec = s->st_mtim.tv_nsec;
+	rec->path_hash = HashPath(path);
+	rec->own = own;
+
+	pthread_mutex_unlock(&cache_lock);
+}
+
+// Writes this run's records next to the cache file and renames the result
+// over it, so an interrupted run never leaves a torn cache behind.
+void CacheSave(void)
+{
+	qsort(cache_new, cache_new_count, sizeof(struct CacheRecord), CompareRecords);
+
+	struct CacheHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = CACHE_MAGIC;
+	hdr.version = CACHE_VERSION;
+	hdr.flags = CacheFlags();
+	hdr.count = cache_new_count;
+
+	char *tmp_path = malloc(strlen(cache_file) + 5);
+	if (tmp_path == NULL)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+	sprintf(tmp_path, "%s.tmp", cache_file);
+
+	FILE *fp = fopen(tmp_path, "wb");
+	if (fp == NULL ||
+		fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+		fwrite(cache_new, sizeof(struct CacheRecord), cache_new_count, fp) != cache_new_count ||
+		fclose(fp) != 0 ||
+		rename(tmp_path, cache_file) != 0)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	free(tmp_path);
+}
+
+///////////////////////////////////////////////////////////////////////
+///////////////////////// Per-directory sizing ////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+// Called for every subdirectory found by DirCalc(). It either returns the
+// subtree total or queues the directory and returns 0.
+typedef long long (*DescendFn)(int dfd, const char *name, const char *path, int level, void *arg);
+
+// The metadata DirCalc() needs, from either stat or statx.
+struct EntryInfo
+{
+	mode_t mode;
+	long long size;
+	long long blocks;
+	dev_t dev;
+	ino_t ino;
+};
+
+// One directory being summed by DirCalc(). own covers the directory itself
+// and the files directly inside it, subdirs the totals of its children.
+struct DirCtx
+{
+	int dfd;
+	const char *path;
+	int level;
+	DescendFn descend;
+	void *arg;
+	long long own;
+	long long subdirs;
+	int cached;
+};
+
+void InfoFromStat(struct EntryInfo *info, struct stat *s)
+{
+	info->mode = s->st_mode;
+	info->size = s->st_size;
+	info->blocks = s->st_blocks;
+	info->dev = s->st_dev;
+	info->ino = s->st_ino;
+}
+
+// True if name, found in path, matches an --exclude pattern. Patterns
+// containing a '/' are matched against the full path, others against the
+// entry name alone.
+int Excluded(const char *path, const char *name)
+{
+	char *full = NULL;
+	int match = 0;
+
+	for (int i = 0; i < num_excludes && !match; i++)
+	{
+		if (strchr(excludes[i], '/') == NULL)
+			match = fnmatch(excludes[i], name, 0) == 0;
+		else
+		{
+			if (full == NULL)
+				full = JoinPath(path, name);
+			match = fnmatch(excludes[i], full, FNM_PATHNAME) == 0;
+		}
+	}
+
+	free(full);
+	return match;
+}
+
+// Whether subdirectories of ctx's directory lie within --max-depth.
+int DepthAllowed(struct DirCtx *ctx)
+{
+	return max_depth < 0 || ctx->level <= max_depth;
+}
+
+// Bytes one inode contributes, or 0 if -H has already counted it. Every
+// file is checked, not just those with several links: entries are stat'ed
+// through symlinks, so a file with one link can still be reached twice.
+long long InodeBytes(struct EntryInfo *info)
+{
+	if (dedupe_links && !InodeFirstSeen(info->dev, info->ino))
+		return 0;
+
+	return count_blocks ? info->blocks * 512 : info->size;
+}
+
+void EntryCalc(struct DirCtx *ctx, const char *name, struct EntryInfo *info)
+{
+	// a cached directory already knows its own bytes
+	if (S_ISREG(info->mode) && !ctx->cached)
+	{
+		long long bytes = InodeBytes(info);
+		ctx->own += bytes;
+		if (top_n)
+			TopAdd(&top_files, bytes, ctx->path, name);
+	}
+	else if (S_ISDIR(info->mode) && DepthAllowed(ctx) && (!one_file_system || info->dev == root_dev))
+		ctx->subdirs += ctx->descend(ctx->dfd, name, ctx->path, ctx->level, ctx->arg);
+}
+
+void StatCalc(struct DirCtx *ctx, const char *name)
+{
+	struct stat s;
+	struct EntryInfo info;
+
+	if (fstatat(ctx->dfd, name, &s, 0) == -1)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
 
-	level++;
+	InfoFromStat(&info, &s);
+	EntryCalc(ctx, name, &info);
+}
+
+// Accounts one entry of a completed statx batch.
+void StatxCalc(struct DirCtx *ctx, struct StatBatch *batch, int i)
+{
+	const char *name = batch->names[i];
+	struct statx *stx = &batch->stx[i];
+	struct EntryInfo info;
 
-	DIR *dp = opendir(dir);
-	if (dp == NULL)
+	// kernels without IORING_OP_STATX report -EINVAL; redo those synchronously
+	if (batch->res[i] == -EINVAL || batch->res[i] == -EOPNOTSUPP)
 	{
+		StatCalc(ctx, name);
+		return;
+	}
+
+	if (batch->res[i] < 0)
+	{
+		errno = -batch->res[i];
 		perror("Unable to execute\n");
 		exit(1);
 	}
 
-	struct dirent *d;
+	info.mode = stx->stx_mode;
+	info.size = stx->stx_size;
+	info.blocks = stx->stx_blocks;
+	info.dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	info.ino = stx->stx_ino;
+	EntryCalc(ctx, name, &info);
+}
+
+// Sums the directory open on dfd: its own size plus every regular file in
+// it. Entries are looked up relative to dfd, so the kernel never re-walks
+// the full path; dfd is closed on return.
+long long DirCalc(int dfd, const char *path, int level, DescendFn descend, void *arg)
+{
 	struct stat s;
-	long long int SZ_DIR = 0;
+	if (fstat(dfd, &s) == -1)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	// under -H a directory reached a second time (e.g. through a symlink)
+	// contributes nothing and is not scanned again
+	if (dedupe_links && !InodeFirstSeen(s.st_dev, s.st_ino))
+	{
+		close(dfd);
+		return 0;
+	}
+
+	struct DirCtx ctx = { dfd, path, level, descend, arg, 0, 0, 0 };
+
+	struct CacheRecord *hit = cache_file ? CacheLookup(&s, path) : NULL;
+	if (hit)
+	{
+		ctx.own = hit->own;
+		ctx.cached = 1;
+	}
+	else
+		ctx.own = count_blocks ? s.st_blocks * 512 : s.st_size;
+
+	struct DirReader dr;
+	const char *name;
+	unsigned char type;
+
+	struct Uring *ring = use_uring ? GetRing() : NULL;
+	struct StatBatch *batch = NULL;
+	if (ring)
+	{
+		batch = malloc(sizeof(struct StatBatch));
+		if (batch == NULL)
+		{
+			perror("Unable to execute\n");
+			exit(1);
+		}
+		batch->count = 0;
+	}
+
+	OpenDirReader(&dr, dfd);
+
+	while (1)
+	{
+		int more = NextEntry(&dr, &name, &type) == 0;
 
-	while ((d = readdir(dp)) != NULL)
+		if (batch && (batch->count == URING_DEPTH || (!more && batch->count)))
+		{
+			SubmitBatch(ring, batch, dfd);
+			for (int i = 0; i < batch->count; i++)
+				StatxCalc(&ctx, batch, i);
+			batch->count = 0;
+		}
+
+		if (!more)
+			break;
+
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+			continue;
+
+		if (num_excludes && Excluded(path, name))
+			continue;
+
+		if (!use_getdents && !ctx.cached)
+			type = DT_UNKNOWN;
+
+		if (type == DT_DIR && !DepthAllowed(&ctx))
+			continue;
+
+		// -x needs the subdirectory's st_dev, so it is stat'ed (but not
+		// opened) before deciding whether to descend
+		if (type == DT_DIR && one_file_system)
+			type = DT_UNKNOWN;
+
+		if (type == DT_DIR)
+		{
+			ctx.subdirs += descend(dfd, name, path, level, arg);
+			continue;
+		}
+
+		// fifos, sockets and devices add nothing; a cached directory
+		// only needs to find its subdirectories
+		if (type != DT_UNKNOWN && type != DT_LNK && (type != DT_REG || ctx.cached))
+			continue;
+
+		if (batch)
+		{
+			strcpy(batch->names[batch->count++], name);
+			continue;
+		}
+
+		StatCalc(&ctx, name);
+	}
+
+	CloseDirReader(&dr);
+	free(batch);
+
+	if (cache_file)
+		CacheAdd(&s, path, ctx.own);
+
+	return ctx.own + ctx.subdirs;
+}
+
+int OpenSubdir(int dfd, const char *name)
+{
+	int fd = openat(dfd, name, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
 	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+	return fd;
+}
+
+// -H, -C and -t keep their inode set, cache records or heaps in this
+// process, so they must not be split across forked children.
+int SingleProcess(void)
+{
+	return dedupe_links || cache_file || top_n;
+}
 
-		int len1 = strlen(dir);
-		int len2 = strlen(d->d_name);
-		char file_path[len1 + len2 + 2];
+// Top-level subdirectories are sized in forked children that all run at
+// once. Each child owns one slot of a MAP_SHARED result array and stores
+// its total there before exiting; the parent reaps them after scanning the
+// root. Slots come in slabs mapped before the fork that uses them, so
+// every child inherits the slab it writes to.
 
-		for (int i = 0; i < len1; i++)
-			file_path[i] = dir[i];
+#define SLAB_SLOTS 512
 
-		file_path[len1] = '/';
+struct ResultSlab
+{
+	long long bytes[SLAB_SLOTS];
+	char done[SLAB_SLOTS];
+};
 
-		for (int i = 0; i < len2; i++)
-			file_path[i + len1 + 1] = d->d_name[i];
+struct ResultSlab **slabs;
+int num_slabs;
+int num_children;
+int running_children;
+int max_children;
 
-		file_path[len1 + len2 + 1] = '\0';
+void WaitChild(void)
+{
+	int status;
 
-		if (stat(file_path, &s) == -1)
+	while (wait(&status) < 0)
+	{
+		if (errno != EINTR)
 		{
 			perror("Unable to execute\n");
 			exit(1);
 		}
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		fprintf(stderr, "Unable to execute\n");
+		exit(1);
+	}
+	running_children--;
+}
 
-		if (S_ISREG(s.st_mode))
-			SZ_DIR += s.st_size;
+long long *NewSlot(void)
+{
+	int slab = num_children / SLAB_SLOTS;
 
-		else if (S_ISDIR(s.st_mode))
+	if (slab == num_slabs)
+	{
+		slabs = realloc(slabs, (num_slabs + 1) * sizeof(struct ResultSlab *));
+		if (slabs == NULL)
 		{
+			perror("Unable to execute\n");
+			exit(1);
+		}
 
-			if(strcmp(d->d_name,".") == 0){
-				SZ_DIR += s.st_size;
-				continue;
-			}
+		struct ResultSlab *rs = mmap(NULL, sizeof(struct ResultSlab), PROT_READ | PROT_WRITE,
+									 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (rs == MAP_FAILED)
+		{
+			perror("Unable to execute\n");
+			exit(1);
+		}
+		slabs[num_slabs++] = rs;
+	}
 
-			if(strcmp(d->d_name , "..") == 0){
-				continue;
-			}
+	return &slabs[slab]->bytes[num_children++ % SLAB_SLOTS];
+}
 
-			int fd[2];
-			char buf[20];
-			if(pipe(fd) < 0){
-				perror("Unable to execute\n");
-				exit(1);
-			}
+// Waits for every child and adds up the slots they filled.
+long long CollectChildren(void)
+{
+	long long total = 0;
 
-			if(level == 1)
-			{
-				int rc = fork();
+	while (running_children > 0)
+		WaitChild();
+
+	for (int i = 0; i < num_children; i++)
+	{
+		struct ResultSlab *rs = slabs[i / SLAB_SLOTS];
+		if (!rs->done[i % SLAB_SLOTS])
+		{
+			fprintf(stderr, "Unable to execute\n");
+			exit(1);
+		}
+		total += rs->bytes[i % SLAB_SLOTS];
+	}
 
-				if(rc < 0){
-					perror("Unable to execute\n");
-					exit(1);
-				}
+	for (int i = 0; i < num_slabs; i++)
+		munmap(slabs[i], sizeof(struct ResultSlab));
+	free(slabs);
+	slabs = NULL;
+	num_slabs = num_children = 0;
 
-				if(rc == 0){
-					long long size_subdr = SizeCalc(file_path, level);
+	return total;
+}
 
-					char num_str[20];
-					sprintf(num_str, "%lld", size_subdr);
+long long SizeCalcAt(int dfd, const char *name, const char *path, int level, void *arg)
+{
+	char *file_path = JoinPath(path, name);
+	long long SZ_DIR = 0;
 
-					if (write(fd[1], num_str, 20) != 20){
-						perror("Unable to execute\n");
-						exit(1);
-					}
-					exit(1);
-				}
+	if (level == 1 && !SingleProcess())
+	{
+		// bound the number of live children to avoid exhausting the
+		// process limit on very wide directories
+		if (running_children == max_children)
+			WaitChild();
 
-				else{
+		int slot = num_children;
+		long long *result = NewSlot();
 
-					if(read(fd[0], buf, 20) != 20){
-						perror("Unable to execute\n");
-						exit(1);
-					}
+		// keep buffered -d lines from being written by both processes
+		OutFlush();
 
-					long long int size_subdr2 = atoll(buf);
-					SZ_DIR += size_subdr2;
-				}
-			}
+		int rc = fork();
 
-			else 
-			{
-				SZ_DIR += SizeCalc(file_path, level);
-			}
+		if(rc < 0){
+			perror("Unable to execute\n");
+			exit(1);
+		}
 
+		if(rc == 0){
+			long long size_subdr = DirCalc(OpenSubdir(dfd, name), file_path, level + 1, SizeCalcAt, arg);
+			DirDone(file_path, size_subdr);
+			OutFlush();
+
+			*result = size_subdr;
+			__atomic_store_n(&slabs[slot / SLAB_SLOTS]->done[slot % SLAB_SLOTS], 1, __ATOMIC_RELEASE);
+			_exit(0);
 		}
 
-		else if(S_ISLNK(s.st_mode)){
+		// the parent picks the total up in CollectChildren()
+		running_children++;
+	}
+
+	else
+	{
+		SZ_DIR = DirCalc(OpenSubdir(dfd, name), file_path, level + 1, SizeCalcAt, arg);
+		DirDone(file_path, SZ_DIR);
+	}
+
+	free(file_path);
+	return SZ_DIR;
+}
+
+long long int SizeCalc(char* dir, int level){
+
+	level++;
+
+	int fd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	max_children = 4 * sysconf(_SC_NPROCESSORS_ONLN);
+	if (max_children < 4)
+		max_children = 4;
+
+	long long SZ_DIR = DirCalc(fd, dir, level, SizeCalcAt, NULL);
+	SZ_DIR += CollectChildren();
+	DirDone(dir, SZ_DIR);
+	return SZ_DIR;
+}
+
+///////////////////////////////////////////////////////////////////////
+///////////////////// Work-stealing thread walker /////////////////////
+///////////////////////////////////////////////////////////////////////
 
-			int sz_link = s.st_size;
-			char target_lnk[sz_link + 1];
+// With -j N every directory, at any depth, is a task. Each worker owns a
+// deque: it pushes the subdirectories it discovers and pops them back from
+// the bottom, while idle workers steal from the top of other deques, so a
+// single deep subtree still spreads over all workers.
+//
+// A task is a DirNode. pending counts the node's own scan plus every
+// child not yet finished; whoever drops it to zero owns the complete
+// subtree total, reports it and folds it into the parent.
 
-			ssize_t len = readlink(target_lnk, file_path, sz_link);
-			if(len == -1){
+struct DirNode
+{
+	char *path;
+	struct DirNode *parent;
+	long long total;
+	long pending;
+	int depth;
+};
+
+struct Deque
+{
+	pthread_mutex_t lock;
+	struct DirNode **tasks;
+	long top;
+	long bottom;
+	long cap;
+};
+
+struct Worker
+{
+	struct Deque dq;
+	int id;
+	pthread_t tid;
+};
+
+struct Worker *workers;
+int num_workers;
+long pending_dirs;
+long long root_total;
+
+struct DirNode *NewDirNode(char *path, struct DirNode *parent, int depth)
+{
+	struct DirNode *node = malloc(sizeof(struct DirNode));
+	if (node == NULL)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	node->path = path;
+	node->parent = parent;
+	node->total = 0;
+	node->pending = 1;
+	node->depth = depth;
+	return node;
+}
+
+void PushDir(struct Worker *w, struct DirNode *node)
+{
+	struct Deque *dq = &w->dq;
+
+	__atomic_add_fetch(&pending_dirs, 1, __ATOMIC_RELAXED);
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom == dq->cap)
+	{
+		// compact stolen slots before growing
+		long used = dq->bottom - dq->top;
+		memmove(dq->tasks, dq->tasks + dq->top, used * sizeof(struct DirNode *));
+		dq->top = 0;
+		dq->bottom = used;
+		if (used * 2 >= dq->cap)
+		{
+			dq->cap = dq->cap ? dq->cap * 2 : 64;
+			dq->tasks = realloc(dq->tasks, dq->cap * sizeof(struct DirNode *));
+			if (dq->tasks == NULL)
+			{
 				perror("Unable to execute\n");
 				exit(1);
 			}
+		}
+	}
+	dq->tasks[dq->bottom++] = node;
+	pthread_mutex_unlock(&dq->lock);
+}
+
+struct DirNode *PopDir(struct Worker *w)
+{
+	struct Deque *dq = &w->dq;
+	struct DirNode *node = NULL;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom > dq->top)
+		node = dq->tasks[--dq->bottom];
+	pthread_mutex_unlock(&dq->lock);
+
+	return node;
+}
+
+struct DirNode *StealDir(struct Worker *w)
+{
+	for (int i = 1; i < num_workers; i++)
+	{
+		struct Deque *dq = &workers[(w->id + i) % num_workers].dq;
+		struct DirNode *node = NULL;
+
+		pthread_mutex_lock(&dq->lock);
+		if (dq->bottom > dq->top)
+			node = dq->tasks[dq->top++];
+		pthread_mutex_unlock(&dq->lock);
+
+		if (node)
+			return node;
+	}
+	return NULL;
+}
+
+struct ScanArg
+{
+	struct Worker *w;
+	struct DirNode *node;
+};
+
+long long QueueDir(int dfd, const char *name, const char *path, int level, void *arg)
+{
+	struct ScanArg *sa = arg;
+	(void)dfd;	// the worker reopens the directory by path
+
+	__atomic_add_fetch(&sa->node->pending, 1, __ATOMIC_RELAXED);
+	PushDir(sa->w, NewDirNode(JoinPath(path, name), sa->node, level));
+	return 0;
+}
+
+// Drops one pending unit of node, and of each ancestor whose subtree
+// completes as a result.
+void FinishDir(struct DirNode *node)
+{
+	while (node && __atomic_sub_fetch(&node->pending, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		struct DirNode *parent = node->parent;
+		long long total = __atomic_load_n(&node->total, __ATOMIC_ACQUIRE);
+
+		DirDone(node->path, total);
+		if (parent)
+			__atomic_add_fetch(&parent->total, total, __ATOMIC_RELEASE);
+		else
+			root_total = total;
+
+		free(node->path);
+		free(node);
+		node = parent;
+	}
+}
+
+void ScanDir(struct Worker *w, struct DirNode *node)
+{
+	int fd = open(node->path, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	struct ScanArg sa = { w, node };
+	long long own = DirCalc(fd, node->path, node->depth + 1, QueueDir, &sa);
+
+	__atomic_add_fetch(&node->total, own, __ATOMIC_RELEASE);
+	FinishDir(node);
+}
+
+void *WorkerMain(void *arg)
+{
+	struct Worker *w = arg;
+
+	while (1)
+	{
+		struct DirNode *node = PopDir(w);
+		if (node == NULL)
+			node = StealDir(w);
+
+		if (node == NULL)
+		{
+			if (__atomic_load_n(&pending_dirs, __ATOMIC_ACQUIRE) == 0)
+				break;
+			sched_yield();
+			continue;
+		}
+
+		ScanDir(w, node);
+		__atomic_sub_fetch(&pending_dirs, 1, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+long long ThreadedSizeCalc(char *dir, int threads)
+{
+	num_workers = threads;
+	workers = calloc(threads, sizeof(struct Worker));
+	if (workers == NULL)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	for (int i = 0; i < threads; i++)
+	{
+		pthread_mutex_init(&workers[i].dq.lock, NULL);
+		workers[i].id = i;
+	}
+
+	char *root = strdup(dir);
+	if (root == NULL)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+	PushDir(&workers[0], NewDirNode(root, NULL, 0));
 
-			SZ_DIR += SizeCalc(target_lnk, level);
+	for (int i = 0; i < threads; i++)
+	{
+		if (pthread_create(&workers[i].tid, NULL, WorkerMain, &workers[i]) != 0)
+		{
+			perror("Unable to execute\n");
+			exit(1);
 		}
 	}
 
-	closedir(dp);
+	for (int i = 0; i < threads; i++)
+	{
+		pthread_join(workers[i].tid, NULL);
+		free(workers[i].dq.tasks);
+	}
+	free(workers);
 
-	return SZ_DIR;
+	return root_total;
 }
 
 int main(int argc, char *argv[])
 {
-	if (argc != 2)
+	int threads = 0;
+	int opt;
+
+	enum { OPT_MAX_DEPTH = 256, OPT_EXCLUDE };
+	static struct option long_opts[] = {
+		{ "max-depth", required_argument, NULL, OPT_MAX_DEPTH },
+		{ "one-file-system", no_argument, NULL, 'x' },
+		{ "exclude", required_argument, NULL, OPT_EXCLUDE },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	excludes = malloc(argc * sizeof(char *));
+	if (excludes == NULL)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	while ((opt = getopt_long(argc, argv, "j:GUBHC:dt:x", long_opts, NULL)) != -1)
+	{
+		if (opt == 'j')
+			threads = atoi(optarg);
+		else if (opt == 'G')
+			use_getdents = 1;
+		else if (opt == 'U')
+			use_uring = 1;
+		else if (opt == 'B')
+			count_blocks = 1;
+		else if (opt == 'H')
+			dedupe_links = 1;
+		else if (opt == 'C')
+			cache_file = optarg;
+		else if (opt == 'd')
+			print_dirs = 1;
+		else if (opt == 't')
+			top_n = atoi(optarg);
+		else if (opt == 'x')
+			one_file_system = 1;
+		else if (opt == OPT_MAX_DEPTH)
+		{
+			max_depth = atoi(optarg);
+			if (max_depth < 0)
+			{
+				perror("Unable to execute\n");
+				exit(1);
+			}
+		}
+		else if (opt == OPT_EXCLUDE)
+		{
+			excludes[num_excludes++] = optarg;
+			exclude_hash = exclude_hash * 31 + HashPath(optarg);
+		}
+		else
+		{
+			perror("Unable to execute\n");
+			exit(1);
+		}
+	}
+
+	if (argc - optind != 1 || threads < 0 || top_n < 0)
 	{
 		perror("Unable to execute\n");
 		exit(1);
 	}
 
-	char *dir = argv[1];
-	int level = 0;
-	long long sz = SizeCalc(dir, level);
+	char *dir = argv[optind];
+	long long sz;
+
+	if (one_file_system)
+	{
+		struct stat s;
+		if (stat(dir, &s) == -1)
+		{
+			perror("Unable to execute\n");
+			exit(1);
+		}
+		root_dev = s.st_dev;
+	}
+
+	if (cache_file)
+		CacheLoad();
+
+	if (threads > 0)
+		sz = ThreadedSizeCalc(dir, threads);
+	else
+	{
+		int level = 0;
+		sz = SizeCalc(dir, level);
+	}
+
+	if (cache_file)
+		CacheSave();
+
+	OutFlush();
+
+	if (top_n)
+	{
+		PrintTop(&top_dirs, "directories");
+		PrintTop(&top_files, "files");
+	}
 
 	printf("%lld\n", sz);
 }
\ No newline at end of file
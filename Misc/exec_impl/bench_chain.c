@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// Chain latency of the exec'ing double/square/sqroot binaries against the
+// in-process calc driver. For k = 1 .. 1000 operations (cycling through
+// double, square, sqroot) it runs
+//   ./double ./square ./sqroot ... 5       (k process images)
+//   ./calc ./double ./square ./sqroot ... 5 (one)
+// and reports the median wall time of each. Both must print the same value.
+//
+// gcc -O2 bench_chain.c -o bench_chain
+// ./bench_chain ./calc ./double ./square ./sqroot [runs]
+
+#define MAX_CHAIN 1000
+
+// Runs argv with stdout on a pipe; returns the wall time and copies the
+// printed line to out.
+double RunChain(char **argv, char *out, int size)
+{
+	struct timespec t0, t1;
+	int fds[2];
+
+	if (pipe(fds) == -1){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	pid_t pid = fork();
+	if (pid < 0){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	if (pid == 0){
+		dup2(fds[1], 1);
+		close(fds[0]);
+		close(fds[1]);
+		execv(argv[0], argv);
+		perror("Unable to execute\n");
+		_exit(1);
+	}
+
+	close(fds[1]);
+	int len = 0, n;
+	while ((n = read(fds[0], out + len, size - 1 - len)) > 0)
+		len += n;
+	close(fds[0]);
+	out[len] = '\0';
+
+	waitpid(pid, NULL, 0);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (len == 0){
+		fprintf(stderr, "%s printed nothing\n", argv[0]);
+		exit(1);
+	}
+	return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+}
+
+int CompareDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+double Median(char **argv, int runs, char *out, int size)
+{
+	double times[runs];
+
+	for (int r = 0; r < runs; r++)
+		times[r] = RunChain(argv, out, size);
+	qsort(times, runs, sizeof(double), CompareDouble);
+	return times[runs / 2];
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 5){
+		fprintf(stderr, "usage: %s ./calc ./double ./square ./sqroot [runs]\n", argv[0]);
+		exit(1);
+	}
+
+	int runs = argc > 5 ? atoi(argv[5]) : 5;
+	if (runs <= 0){
+		fprintf(stderr, "usage: %s ./calc ./double ./square ./sqroot [runs]\n", argv[0]);
+		exit(1);
+	}
+
+	int lengths[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+	char *args[MAX_CHAIN + 3];
+	char exec_out[64], calc_out[64];
+
+	// args[0] is calc, so args + 1 is the same chain without it
+	args[0] = argv[1];
+
+	printf("%6s %12s %12s %8s\n", "k", "exec ms", "calc ms", "speedup");
+	for (int i = 0; i < (int)(sizeof(lengths) / sizeof(lengths[0])); i++)
+	{
+		int k = lengths[i];
+
+		for (int j = 0; j < k; j++)
+			args[j + 1] = argv[2 + j % 3];
+		args[k + 1] = "5";
+		args[k + 2] = NULL;
+
+		double exec_time = Median(args + 1, runs, exec_out, sizeof(exec_out));
+		double calc_time = Median(args, runs, calc_out, sizeof(calc_out));
+
+		if (strcmp(exec_out, calc_out) != 0){
+			fprintf(stderr, "k = %d: results differ (%s vs %s)\n", k, exec_out, calc_out);
+			exit(1);
+		}
+
+		printf("%6d %12.3f %12.3f %8.1f\n", k, exec_time * 1e3, calc_time * 1e3, exec_time / calc_time);
+	}
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "calc.h"
+
+// Fused plans against calc's interpreted dispatch of the same chains
+// (CalcRunInterp): every operation is looked up once (CalcLookup) and then
+// calls it through a function pointer per value, clamping between
+// operations as the exec'd binaries do. The fused plan is timed per value
+// (CalcRun) and per block (CalcRunBlock, AVX2 where available). All three
+// must agree.
+//
+// gcc -O2 -DCALC_LIBRARY bench_fuse.c calc.c -o bench_fuse -lm
+// ./bench_fuse [values]
+
+#define REPEAT_OPS 50000000L
+
+double Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// count names, from pattern repeated
+void MakeChain(char **names, int count, const char *pattern)
+{
+	const char *all[] = { "./double", "./square", "./sqroot" };
+
+	for (int i = 0; i < count; i++)
+		names[i] = (char *)all[pattern[i % strlen(pattern)] - '0'];
+}
+
+int main(int argc, char *argv[])
+{
+	long n = argc > 1 ? atol(argv[1]) : 4096;
+	if (n <= 0){
+		fprintf(stderr, "usage: %s [values]\n", argv[0]);
+		exit(1);
+	}
+
+	// patterns over 0 = double, 1 = square, 2 = sqroot
+	struct { const char *name; const char *pattern; int count; } chains[] = {
+		{ "d d s r", "0012", 4 },
+		{ "64 x d", "0", 64 },
+		{ "1000 x d", "0", 1000 },
+		{ "d s r x 333", "012", 999 },
+		{ "d d d r x 250", "0002", 1000 },
+	};
+
+	unsigned long *in = malloc(n * sizeof(unsigned long));
+	unsigned long *out = malloc(n * sizeof(unsigned long));
+	char **names = malloc(1000 * sizeof(char *));
+	CalcOpFn *fns = malloc(1000 * sizeof(CalcOpFn));
+	if (!in || !out || !names || !fns){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	unsigned long x = 88172645463325252UL;
+	for (long i = 0; i < n; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		in[i] = x >> (x % 64);
+	}
+
+	printf("%-14s %6s %14s %14s %14s\n", "chain", "steps", "interp ns/val", "run ns/val", "block ns/val");
+	for (int c = 0; c < (int)(sizeof(chains) / sizeof(chains[0])); c++)
+	{
+		int count = chains[c].count;
+		MakeChain(names, count, chains[c].pattern);
+		for (int i = 0; i < count; i++)
+			fns[i] = CalcLookup(names[i]);
+
+		struct CalcPlan *plan = CalcCompile(names, count);
+		long reps = REPEAT_OPS / ((long)count * n) + 1;
+		// the interpreted and CalcRun() sums cancel when they agree
+		unsigned long check = 0;
+
+		double start = Now();
+		for (long r = 0; r < reps; r++)
+			for (long i = 0; i < n; i++)
+				check += CalcRunInterp(fns, count, in[i]);
+		double interp = (Now() - start) / (reps * n);
+
+		start = Now();
+		for (long r = 0; r < reps; r++)
+			for (long i = 0; i < n; i++)
+				check -= CalcRun(plan, in[i]);
+		double run = (Now() - start) / (reps * n);
+
+		double block = 0;
+		for (long r = 0; r < reps; r++)
+		{
+			memcpy(out, in, n * sizeof(unsigned long));
+			start = Now();
+			CalcRunBlock(plan, out, n);
+			block += Now() - start;
+		}
+		block /= reps * n;
+
+		for (long i = 0; i < n; i++)
+		{
+			if (out[i] != CalcRunInterp(fns, count, in[i]))
+				check = 1;
+		}
+		if (check){
+			fprintf(stderr, "%s: fused and interpreted results differ\n", chains[c].name);
+			exit(1);
+		}
+
+		printf("%-14s %6d %14.1f %14.1f %14.1f\n", chains[c].name, plan->len, interp * 1e9, run * 1e9, block * 1e9);
+		CalcFree(plan);
+	}
+
+	free(in);
+	free(out);
+	free(names);
+	free(fns);
+	return 0;
+}
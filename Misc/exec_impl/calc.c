@@ -0,0 +1,1055 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "calc.h"
+
+// Takes the same arguments as the double/square/sqroot chain, e.g.
+// ./calc ./double ./square ./sqroot 5, but applies every known operation
+// in this process instead of exec'ing one binary per step. The first
+// program it does not know is exec'ed with the rest of the chain and the
+// value computed so far, exactly as the chain would have done. Each
+// operation after the first sees its input as atol() would have parsed it
+// from the previous binary's output, so values above LONG_MAX are clamped.
+//
+// ./calc -b [-f file] ./double ./square ... applies the chain to every
+// number read from stdin (or the mmapped file) and prints one result per
+// line.
+//
+// ./calc -w 128 ... and ./calc -w big ... compute a single chain on 128-bit
+// or arbitrary-width numbers instead of unsigned long, so long chains of
+// squares neither wrap at 64 bits nor overflow the decimal buffer.
+//
+// Built with -DCALC_LIBRARY, only the operations and the fused-chain entry
+// points declared in calc.h are compiled, without main().
+
+unsigned long Double(unsigned long num)
+{
+	return num * 2;
+}
+
+unsigned long Square(unsigned long num)
+{
+	return num * num;
+}
+
+// round() takes a double, so the root is rounded to 53 bits before it is
+// rounded to an integer.
+unsigned long Sqroot(unsigned long num)
+{
+	return round(sqrtl(num));
+}
+
+#if defined(__x86_64__)
+
+#define AVX2 __attribute__((target("avx2")))
+
+// Low 64 bits of a * b per lane; AVX2 only multiplies 32-bit halves.
+static inline AVX2 __m256i Mul64(__m256i a, __m256i b)
+{
+	__m256i lo = _mm256_mul_epu32(a, b);
+	__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+									 _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+	return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+// Unsigned a > b per lane.
+static inline AVX2 __m256i CmpGtU64(__m256i a, __m256i b)
+{
+	__m256i sign = _mm256_set1_epi64x(1UL << 63);
+	return _mm256_cmpgt_epi64(_mm256_xor_si256(a, sign), _mm256_xor_si256(b, sign));
+}
+
+// Clamp() per lane: values above LONG_MAX are negative as signed.
+static inline AVX2 __m256i ClampVec(__m256i x)
+{
+	__m256i over = _mm256_cmpgt_epi64(_mm256_setzero_si256(), x);
+	return _mm256_blendv_epi8(x, _mm256_set1_epi64x(LONG_MAX), over);
+}
+
+// A double sqrt gives a candidate that is corrected to the integer nearest
+// to the exact root with 64-bit integer checks. Sqroot() instead rounds the
+// root to a double first; when the root lies within about x / 2^52 of
+// r + 0.5 (x close to r * r + r) that can land on the half and round the
+// other way. Such lanes, and those too large for the checks, are flagged
+// in *redo for the caller to recompute in scalar code.
+static inline AVX2 __m256i SqrootVec(__m256i x, int *redo)
+{
+	const __m256i magic_lo = _mm256_set1_epi64x(0x4330000000000000L);
+	const __m256i magic_hi = _mm256_set1_epi64x(0x4530000000000000L);
+	const __m256d magic_both = _mm256_set1_pd(19342813118337666422669312.0);	// 2^84 + 2^52
+	const __m256d two52 = _mm256_set1_pd(4503599627370496.0);
+	const __m256i max_r = _mm256_set1_epi64x(0xfffffffeL);
+
+	// exact split conversion of unsigned 64-bit lanes to double
+	__m256i lo = _mm256_or_si256(_mm256_blend_epi32(x, _mm256_setzero_si256(), 0xaa), magic_lo);
+	__m256i hi = _mm256_or_si256(_mm256_srli_epi64(x, 32), magic_hi);
+	__m256d d = _mm256_add_pd(_mm256_sub_pd(_mm256_castsi256_pd(hi), magic_both), _mm256_castsi256_pd(lo));
+
+	__m256d s = _mm256_floor_pd(_mm256_add_pd(_mm256_sqrt_pd(d), _mm256_set1_pd(0.5)));
+	__m256i r = _mm256_xor_si256(_mm256_castpd_si256(_mm256_add_pd(s, two52)), _mm256_castpd_si256(two52));
+	__m256i big = CmpGtU64(r, max_r);
+
+	// nearest integer r satisfies r * r - r < x <= r * r + r
+	__m256i sq = Mul64(r, r);
+	__m256i up = CmpGtU64(x, _mm256_add_epi64(sq, r));
+	__m256i down = _mm256_andnot_si256(CmpGtU64(x, _mm256_sub_epi64(sq, r)),
+									   CmpGtU64(r, _mm256_setzero_si256()));
+	r = _mm256_add_epi64(_mm256_sub_epi64(r, up), down);
+
+	// |x - (r * r + r)| <= w, with w a generous bound on the double's
+	// half ulp scaled back to x
+	__m256i w = _mm256_add_epi64(_mm256_srli_epi64(x, 50), _mm256_set1_epi64x(2));
+	__m256i diff = _mm256_sub_epi64(x, _mm256_add_epi64(Mul64(r, r), r));
+	__m256i tie = _mm256_xor_si256(CmpGtU64(_mm256_add_epi64(diff, w), _mm256_add_epi64(w, w)),
+								   _mm256_set1_epi64x(-1));
+
+	*redo |= _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_or_si256(big, tie)));
+	return r;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////
+//////////////////////////// 128-bit mode /////////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+// Wraps modulo 2^128 like the unsigned long versions wrap modulo 2^64.
+// sqroot rounds the exact root to the nearest integer.
+
+typedef unsigned __int128 u128;
+typedef u128 (*Op128Fn)(u128 num);
+
+u128 Double128(u128 num)
+{
+	return num * 2;
+}
+
+u128 Square128(u128 num)
+{
+	return num * num;
+}
+
+u128 Sqroot128(u128 num)
+{
+	const u128 max_root = ~0UL;
+	u128 root = sqrtl((long double)num);
+
+	// the long double estimate is within a few units; settle it to the
+	// floor of the root, then round
+	if (root > max_root)
+		root = max_root;
+	while (root * root > num)
+		root--;
+	while (root < max_root && (root + 1) * (root + 1) <= num)
+		root++;
+
+	return num - root * root > root ? root + 1 : root;
+}
+
+// Decimal digits of num, an optional sign and wraparound as for atol().
+u128 Parse128(const char *str)
+{
+	int neg = 0;
+	u128 num = 0;
+
+	while (*str == ' ' || (*str >= '\t' && *str <= '\r'))
+		str++;
+	if (*str == '+' || *str == '-')
+		neg = *str++ == '-';
+	for (; *str >= '0' && *str <= '9'; str++)
+		num = num * 10 + (*str - '0');
+
+	return neg ? -num : num;
+}
+
+char *Format128(u128 num)
+{
+	char *str = malloc(40);
+	char digits[40];
+	int len = 0;
+
+	if (str == NULL){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	do
+	{
+		digits[len++] = '0' + num % 10;
+		num /= 10;
+	} while (num);
+
+	for (int i = 0; i < len; i++)
+		str[i] = digits[len - 1 - i];
+	str[len] = '\0';
+	return str;
+}
+
+///////////////////////////////////////////////////////////////////////
+//////////////////////////// Bignum mode //////////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+// Exact non-negative integers as 64-bit limbs, least significant first,
+// handed from one stage to the next without going through decimal.
+
+struct Big
+{
+	unsigned long *limbs;
+	long len;		// no leading zero limbs; 0 for zero
+	long cap;
+};
+
+typedef void (*OpBigFn)(struct Big *num);
+
+void BigReserve(struct Big *b, long cap)
+{
+	if (cap <= b->cap)
+		return;
+
+	b->limbs = realloc(b->limbs, cap * sizeof(unsigned long));
+	if (b->limbs == NULL){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+	b->cap = cap;
+}
+
+void BigTrim(struct Big *b)
+{
+	while (b->len > 0 && b->limbs[b->len - 1] == 0)
+		b->len--;
+}
+
+void BigCopy(struct Big *dst, struct Big *src)
+{
+	BigReserve(dst, src->len + 1);
+	memcpy(dst->limbs, src->limbs, src->len * sizeof(unsigned long));
+	dst->len = src->len;
+}
+
+// b = b * mul + add
+void BigMulAdd(struct Big *b, unsigned long mul, unsigned long add)
+{
+	u128 carry = add;
+
+	for (long i = 0; i < b->len; i++)
+	{
+		carry += (u128)b->limbs[i] * mul;
+		b->limbs[i] = carry;
+		carry >>= 64;
+	}
+
+	if (carry)
+	{
+		BigReserve(b, b->len + 1);
+		b->limbs[b->len++] = carry;
+	}
+}
+
+// b = b / div, returning the remainder
+unsigned long BigDivSmall(struct Big *b, unsigned long div)
+{
+	u128 rem = 0;
+
+	for (long i = b->len - 1; i >= 0; i--)
+	{
+		rem = rem << 64 | b->limbs[i];
+		b->limbs[i] = rem / div;
+		rem %= div;
+	}
+
+	BigTrim(b);
+	return rem;
+}
+
+// b = b + 2^bit
+void BigAddBit(struct Big *b, long bit)
+{
+	long i = bit / 64;
+
+	BigReserve(b, (b->len > i ? b->len : i) + 1);
+	while (b->len <= i)
+		b->limbs[b->len++] = 0;
+
+	unsigned long add = 1UL << (bit % 64);
+	for (; add && i < b->len; i++)
+	{
+		b->limbs[i] += add;
+		add = b->limbs[i] < add;
+	}
+	if (add)
+		b->limbs[b->len++] = 1;
+}
+
+int BigCompare(struct Big *a, struct Big *b)
+{
+	if (a->len != b->len)
+		return a->len < b->len ? -1 : 1;
+
+	for (long i = a->len - 1; i >= 0; i--)
+	{
+		if (a->limbs[i] != b->limbs[i])
+			return a->limbs[i] < b->limbs[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+// a = a - b, for a >= b
+void BigSub(struct Big *a, struct Big *b)
+{
+	unsigned long borrow = 0;
+
+	for (long i = 0; i < a->len; i++)
+	{
+		unsigned long sub = i < b->len ? b->limbs[i] : 0;
+		unsigned long val = a->limbs[i] - sub - borrow;
+		borrow = a->limbs[i] < sub || (a->limbs[i] == sub && borrow);
+		a->limbs[i] = val;
+	}
+	BigTrim(a);
+}
+
+void BigShiftRight(struct Big *b, int shift)
+{
+	for (long i = 0; i < b->len; i++)
+	{
+		b->limbs[i] >>= shift;
+		if (i + 1 < b->len)
+			b->limbs[i] |= b->limbs[i + 1] << (64 - shift);
+	}
+	BigTrim(b);
+}
+
+long BigBits(struct Big *b)
+{
+	if (b->len == 0)
+		return 0;
+	return (b->len - 1) * 64 + 64 - __builtin_clzl(b->limbs[b->len - 1]);
+}
+
+void BigDouble(struct Big *num)
+{
+	unsigned long carry = 0;
+
+	for (long i = 0; i < num->len; i++)
+	{
+		unsigned long top = num->limbs[i] >> 63;
+		num->limbs[i] = num->limbs[i] << 1 | carry;
+		carry = top;
+	}
+
+	if (carry)
+	{
+		BigReserve(num, num->len + 1);
+		num->limbs[num->len++] = carry;
+	}
+}
+
+// Schoolbook squaring: each cross product is computed once and doubled.
+void BigSquare(struct Big *num)
+{
+	long n = num->len;
+	struct Big res = { NULL, 0, 0 };
+
+	if (n == 0)
+		return;
+
+	BigReserve(&res, 2 * n);
+	memset(res.limbs, 0, 2 * n * sizeof(unsigned long));
+	res.len = 2 * n;
+
+	for (long i = 0; i < n; i++)
+	{
+		u128 carry = 0;
+		for (long j = i + 1; j < n; j++)
+		{
+			carry += (u128)num->limbs[i] * num->limbs[j] + res.limbs[i + j];
+			res.limbs[i + j] = carry;
+			carry >>= 64;
+		}
+		res.limbs[i + n] = carry;
+	}
+
+	BigDouble(&res);
+	res.len = 2 * n;
+
+	u128 carry = 0;
+	for (long i = 0; i < n; i++)
+	{
+		u128 sq = (u128)num->limbs[i] * num->limbs[i];
+
+		carry += (unsigned long)sq;
+		carry += res.limbs[2 * i];
+		res.limbs[2 * i] = carry;
+		carry >>= 64;
+
+		carry += sq >> 64;
+		carry += res.limbs[2 * i + 1];
+		res.limbs[2 * i + 1] = carry;
+		carry >>= 64;
+	}
+	BigTrim(&res);
+
+	free(num->limbs);
+	*num = res;
+}
+
+// Binary digit-by-digit square root, rounded to the nearest integer.
+void BigSqroot(struct Big *num)
+{
+	struct Big root = { NULL, 0, 0 };
+	struct Big trial = { NULL, 0, 0 };
+
+	long bit = BigBits(num) - 1;
+	if (bit < 0)
+		return;
+	bit -= bit % 2;
+
+	BigReserve(&root, num->len + 1);
+
+	// num ends up holding the remainder num - root^2
+	for (; bit >= 0; bit -= 2)
+	{
+		BigCopy(&trial, &root);
+		BigAddBit(&trial, bit);
+
+		BigShiftRight(&root, 1);
+		if (BigCompare(num, &trial) >= 0)
+		{
+			BigSub(num, &trial);
+			BigAddBit(&root, bit);
+		}
+	}
+
+	if (BigCompare(num, &root) > 0)
+		BigAddBit(&root, 0);
+
+	free(trial.limbs);
+	free(num->limbs);
+	*num = root;
+}
+
+// Decimal digits as for atol(), except that there is no upper limit.
+// Negative numbers have no representation here.
+void BigParse(struct Big *b, const char *str)
+{
+	b->len = 0;
+
+	while (*str == ' ' || (*str >= '\t' && *str <= '\r'))
+		str++;
+	if (*str == '-'){
+		fprintf(stderr, "Unable to execute\n");
+		exit(1);
+	}
+	if (*str == '+')
+		str++;
+
+	// 19 decimal digits at a time fit in one limb
+	while (*str >= '0' && *str <= '9')
+	{
+		unsigned long chunk = 0;
+		unsigned long scale = 1;
+
+		for (int i = 0; i < 19 && *str >= '0' && *str <= '9'; i++, str++)
+		{
+			chunk = chunk * 10 + (*str - '0');
+			scale *= 10;
+		}
+
+		BigMulAdd(b, scale, chunk);
+	}
+}
+
+char *BigFormat(struct Big *b)
+{
+	struct Big tmp = { NULL, 0, 0 };
+	long max = (BigBits(b) / 3 + 2) + 19;
+	char *digits = malloc(max);
+	char *str = malloc(max);
+	long len = 0;
+
+	if (digits == NULL || str == NULL){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	BigCopy(&tmp, b);
+	do
+	{
+		unsigned long chunk = BigDivSmall(&tmp, 10000000000000000000UL);
+		for (int i = 0; i < 19 && (tmp.len || chunk); i++)
+		{
+			digits[len++] = '0' + chunk % 10;
+			chunk /= 10;
+		}
+	} while (tmp.len);
+
+	if (len == 0)
+		digits[len++] = '0';
+	for (long i = 0; i < len; i++)
+		str[i] = digits[len - 1 - i];
+	str[len] = '\0';
+
+	free(digits);
+	free(tmp.limbs);
+	return str;
+}
+
+///////////////////////////////////////////////////////////////////////
+///////////////////////////// Operations //////////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+enum { OP_DOUBLE, OP_SQUARE, OP_SQROOT };
+
+struct Op
+{
+	const char *name;
+	int kind;
+	CalcOpFn fn;
+	Op128Fn fn128;
+	OpBigFn fnbig;
+};
+
+struct Op ops[] = {
+	{ "double", OP_DOUBLE, Double, Double128, BigDouble },
+	{ "square", OP_SQUARE, Square, Square128, BigSquare },
+	{ "sqroot", OP_SQROOT, Sqroot, Sqroot128, BigSqroot },
+};
+
+// Looks a program up by its file name, ignoring the directory part.
+struct Op *FindOp(const char *prog)
+{
+	const char *name = strrchr(prog, '/');
+	name = name ? name + 1 : prog;
+
+	for (int i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++)
+	{
+		if (strcmp(ops[i].name, name) == 0)
+			return &ops[i];
+	}
+	return NULL;
+}
+
+CalcOpFn CalcLookup(const char *prog)
+{
+	struct Op *op = FindOp(prog);
+	return op ? op->fn : NULL;
+}
+
+// What atol() makes of a value printed with %lu.
+static inline unsigned long Clamp(unsigned long num)
+{
+	return num > LONG_MAX ? LONG_MAX : num;
+}
+
+unsigned long CalcRunInterp(CalcOpFn *fns, int count, unsigned long num)
+{
+	if (count == 0)
+		return num;
+
+	num = fns[0](num);
+	for (int i = 1; i < count; i++)
+		num = fns[i](Clamp(num));
+	return num;
+}
+
+///////////////////////////////////////////////////////////////////////
+/////////////////////////// Fused chains //////////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+// Closes the step being built. A run of k doublings is one doubling and a
+// shift by k - 1; the shift is exact only while every intermediate value
+// stays within LONG_MAX, i.e. for inputs up to limit, and any larger input
+// ends at 2 * LONG_MAX.
+void CalcAddStep(struct CalcPlan *plan, struct CalcStep *cur)
+{
+	if (cur->doubles)
+	{
+		int rest = cur->doubles - 1;
+		cur->shift = rest < 63 ? rest : 63;
+		cur->limit = rest == 0 ? ULONG_MAX : rest <= 63 ? (unsigned long)LONG_MAX >> (rest - 1) : 0;
+	}
+
+	plan->steps[plan->len++] = *cur;
+	*cur = (struct CalcStep){ 0, 0, 0, 0, 0 };
+}
+
+struct CalcPlan *CalcCompile(char **names, int count)
+{
+	struct CalcPlan *plan = malloc(sizeof(struct CalcPlan) + (count + 1) * sizeof(struct CalcStep));
+	struct CalcStep cur = { 0, 0, 0, 0, 0 };
+
+	if (plan == NULL){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+	plan->len = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		struct Op *op = FindOp(names[i]);
+		if (op == NULL)
+		{
+			free(plan);
+			return NULL;
+		}
+
+		if (op->kind == OP_DOUBLE)
+			cur.doubles++;
+		else if (op->kind == OP_SQUARE)
+		{
+			// squares only run before the doublings of a step
+			if (cur.doubles)
+				CalcAddStep(plan, &cur);
+			cur.squares++;
+		}
+		else
+		{
+			cur.sqroot = 1;
+			CalcAddStep(plan, &cur);
+		}
+	}
+
+	if (cur.squares || cur.doubles)
+		CalcAddStep(plan, &cur);
+
+	return plan;
+}
+
+unsigned long CalcRun(const struct CalcPlan *plan, unsigned long num)
+{
+	// only the first operation sees the input unclamped
+	int first = 1;
+
+	for (int i = 0; i < plan->len; i++)
+	{
+		const struct CalcStep *step = &plan->steps[i];
+
+		for (int j = 0; j < step->squares; j++)
+		{
+			if (!first)
+				num = Clamp(num);
+			num *= num;
+			first = 0;
+		}
+
+		if (step->doubles)
+		{
+			if (!first)
+				num = Clamp(num);
+			num <<= 1;
+			num = num <= step->limit ? num << step->shift : ULONG_MAX - 1;
+			first = 0;
+		}
+
+		if (step->sqroot)
+		{
+			if (!first)
+				num = Clamp(num);
+			num = Sqroot(num);
+			first = 0;
+		}
+	}
+	return num;
+}
+
+#if defined(__x86_64__)
+
+// Every step runs on four lanes in registers before the block is stored.
+AVX2 void CalcRunAvx2(const struct CalcPlan *plan, unsigned long *v, long n)
+{
+	long i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m256i x = _mm256_loadu_si256((__m256i *)(v + i));
+		int redo = 0;
+		int first = 1;
+
+		for (int j = 0; j < plan->len; j++)
+		{
+			const struct CalcStep *step = &plan->steps[j];
+
+			for (int k = 0; k < step->squares; k++)
+			{
+				if (!first)
+					x = ClampVec(x);
+				x = Mul64(x, x);
+				first = 0;
+			}
+
+			if (step->doubles)
+			{
+				if (!first)
+					x = ClampVec(x);
+				x = _mm256_slli_epi64(x, 1);
+				__m256i over = CmpGtU64(x, _mm256_set1_epi64x(step->limit));
+				x = _mm256_blendv_epi8(_mm256_sll_epi64(x, _mm_cvtsi32_si128(step->shift)),
+									   _mm256_set1_epi64x(ULONG_MAX - 1), over);
+				first = 0;
+			}
+
+			if (step->sqroot)
+			{
+				if (!first)
+					x = ClampVec(x);
+				x = SqrootVec(x, &redo);
+				first = 0;
+			}
+		}
+
+		unsigned long in[4];
+		if (redo)
+			memcpy(in, v + i, sizeof(in));
+
+		_mm256_storeu_si256((__m256i *)(v + i), x);
+		for (int j = 0; redo; j++, redo >>= 1)
+		{
+			if (redo & 1)
+				v[i + j] = CalcRun(plan, in[j]);
+		}
+	}
+
+	for (; i < n; i++)
+		v[i] = CalcRun(plan, v[i]);
+}
+
+#endif
+
+void CalcRunBlock(const struct CalcPlan *plan, unsigned long *v, long n)
+{
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("avx2"))
+	{
+		CalcRunAvx2(plan, v, n);
+		return;
+	}
+#endif
+
+	for (long i = 0; i < n; i++)
+		v[i] = CalcRun(plan, v[i]);
+}
+
+void CalcFree(struct CalcPlan *plan)
+{
+	free(plan);
+}
+
+#ifndef CALC_LIBRARY
+
+///////////////////////////////////////////////////////////////////////
+//////////////////////////////// Batch mode ///////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+#define BATCH_BLOCK 4096
+#define READ_BUF_SIZE (1024 * 1024)
+#define OUT_BUF_SIZE (64 * 1024)
+
+struct CalcPlan *plan;
+unsigned long vals[BATCH_BLOCK];
+int num_vals;
+char out_buf[OUT_BUF_SIZE];
+int out_len;
+
+void FlushOut(void)
+{
+	if (fwrite(out_buf, 1, out_len, stdout) != (size_t)out_len){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+	out_len = 0;
+}
+
+// Runs the chain over the buffered numbers and prints the results.
+void FlushVals(void)
+{
+	CalcRunBlock(plan, vals, num_vals);
+
+	for (int i = 0; i < num_vals; i++)
+	{
+		char digits[20];
+		int len = 0;
+		unsigned long num = vals[i];
+
+		do
+		{
+			digits[len++] = '0' + num % 10;
+			num /= 10;
+		} while (num);
+
+		if (out_len + len + 1 > OUT_BUF_SIZE)
+			FlushOut();
+		while (len)
+			out_buf[out_len++] = digits[--len];
+		out_buf[out_len++] = '\n';
+	}
+	num_vals = 0;
+}
+
+int IsSpace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// atol() of one token: an optional sign and the digits up to the first
+// other character, clamped to the range of long as strtol() does.
+unsigned long ParseToken(const char *p, const char *end)
+{
+	int neg = 0;
+	int overflow = 0;
+	unsigned long val = 0;
+
+	if (p < end && (*p == '+' || *p == '-'))
+		neg = *p++ == '-';
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++)
+	{
+		unsigned int digit = *p - '0';
+		if (val > (ULONG_MAX - digit) / 10)
+			overflow = 1;
+		else
+			val = val * 10 + digit;
+	}
+
+	unsigned long limit = neg ? (unsigned long)LONG_MAX + 1 : LONG_MAX;
+	if (overflow || val > limit)
+		val = limit;
+
+	return neg ? -val : val;
+}
+
+// Parses every whitespace-separated token in [p, end).
+void ParseRange(const char *p, const char *end)
+{
+	while (1)
+	{
+		while (p < end && IsSpace(*p))
+			p++;
+		if (p == end)
+			return;
+
+		const char *tok = p;
+		while (p < end && !IsSpace(*p))
+			p++;
+
+		vals[num_vals++] = ParseToken(tok, p);
+		if (num_vals == BATCH_BLOCK)
+			FlushVals();
+	}
+}
+
+void BatchFile(const char *file)
+{
+	int fd = open(file, O_RDONLY);
+	struct stat s;
+	if (fd < 0 || fstat(fd, &s) == -1){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	if (s.st_size > 0)
+	{
+		char *map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED){
+			perror("Unable to execute\n");
+			exit(1);
+		}
+		madvise(map, s.st_size, MADV_SEQUENTIAL);
+
+		ParseRange(map, map + s.st_size);
+		munmap(map, s.st_size);
+	}
+	close(fd);
+}
+
+void BatchStdin(void)
+{
+	char *buf = malloc(READ_BUF_SIZE);
+	long len = 0;
+
+	if (buf == NULL){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	while (1)
+	{
+		long ret = read(STDIN_FILENO, buf + len, READ_BUF_SIZE - len);
+		if (ret < 0){
+			perror("Unable to execute\n");
+			exit(1);
+		}
+		len += ret;
+
+		if (ret == 0)
+		{
+			ParseRange(buf, buf + len);
+			break;
+		}
+
+		// hold back a token that may continue in the next read; one that
+		// fills the whole buffer is cut there
+		long keep = len;
+		while (keep > 0 && !IsSpace(buf[keep - 1]))
+			keep--;
+		if (keep == 0 && len == READ_BUF_SIZE)
+			keep = len;
+
+		ParseRange(buf, buf + keep);
+		memmove(buf, buf + keep, len - keep);
+		len -= keep;
+	}
+
+	free(buf);
+}
+
+int BatchMain(int argc, char *argv[])
+{
+	const char *file = NULL;
+	int i = 2;
+
+	if (i + 1 < argc && strcmp(argv[i], "-f") == 0)
+	{
+		file = argv[i + 1];
+		i += 2;
+	}
+
+	plan = CalcCompile(argv + i, argc - i);
+	if (plan == NULL){
+		fprintf(stderr, "Unable to execute\n");
+		exit(1);
+	}
+
+	if (file)
+		BatchFile(file);
+	else
+		BatchStdin();
+
+	FlushVals();
+	FlushOut();
+	CalcFree(plan);
+	return 0;
+}
+
+// The number being passed down a single chain, in the chosen width.
+enum { WIDTH_64, WIDTH_128, WIDTH_BIG };
+
+struct Value
+{
+	int width;
+	unsigned long num;
+	u128 num128;
+	struct Big big;
+};
+
+void ApplyOp(struct Op *op, struct Value *v)
+{
+	if (v->width == WIDTH_128)
+		v->num128 = op->fn128(v->num128);
+	else
+		op->fnbig(&v->big);
+}
+
+char *FormatValue(struct Value *v)
+{
+	if (v->width == WIDTH_128)
+		return Format128(v->num128);
+	if (v->width == WIDTH_BIG)
+		return BigFormat(&v->big);
+
+	char *str = malloc(24);
+	if (str == NULL){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+	sprintf(str, "%lu", v->num);
+	return str;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2){
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	if (strcmp(argv[1], "-b") == 0)
+		return BatchMain(argc, argv);
+
+	struct Value v = { WIDTH_64, 0, 0, { NULL, 0, 0 } };
+	int first = 1;
+
+	if (argc > 3 && strcmp(argv[1], "-w") == 0)
+	{
+		if (strcmp(argv[2], "128") == 0)
+			v.width = WIDTH_128;
+		else if (strcmp(argv[2], "big") == 0)
+			v.width = WIDTH_BIG;
+		else if (strcmp(argv[2], "64") != 0){
+			fprintf(stderr, "Unable to execute\n");
+			exit(1);
+		}
+		first = 3;
+	}
+
+	if (v.width == WIDTH_64)
+		v.num = atol(argv[argc - 1]);
+	else if (v.width == WIDTH_128)
+		v.num128 = Parse128(argv[argc - 1]);
+	else
+		BigParse(&v.big, argv[argc - 1]);
+
+	// installed (or linked) under an operation's name, calc runs that
+	// operation first, like the standalone binary would
+	char *names[argc];
+	int count = 0;
+	if (FindOp(argv[0]))
+		names[count++] = argv[0];
+
+	int i = first;
+	for (; i < argc - 1 && FindOp(argv[i]); i++)
+		names[count++] = argv[i];
+
+	if (v.width == WIDTH_64)
+	{
+		struct CalcPlan *chain = CalcCompile(names, count);
+		v.num = CalcRun(chain, v.num);
+		CalcFree(chain);
+	}
+	else
+	{
+		for (int j = 0; j < count; j++)
+			ApplyOp(FindOp(names[j]), &v);
+	}
+
+	char *num_string = FormatValue(&v);
+
+	if (i == argc - 1){
+		printf("%s\n", num_string);
+		exit(1);
+	}
+
+	char *myArgs[argc - i + 1];
+	for (int j = i; j < argc - 1; j++){
+		myArgs[j - i] = argv[j];
+	}
+	myArgs[argc - 1 - i] = num_string;
+	myArgs[argc - i] = NULL;
+
+	execv(myArgs[0], myArgs);
+
+	perror("Unable to execute\n");
+
+	return 0;
+}
+
+#endif
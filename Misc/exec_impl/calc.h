@@ -0,0 +1,42 @@
+#ifndef __CALC_H_
+#define __CALC_H_
+
+// One step of a fused unsigned long chain. Like the exec'd binaries, every
+// operation after the first reads its input through atol(), so a value
+// above LONG_MAX reaches it as LONG_MAX. A run of doublings still folds
+// into one doubling and one shift, which saturates where the clamps would
+// have; squarings are kept one by one, as a clamp may fall between them.
+struct CalcStep
+{
+	int squares;	// x = x * x, squares times
+	int doubles;	// then x <<= 1, doubles times
+	int sqroot;		// then x = round(sqrtl(x))
+	int shift;		// doubles - 1, at most 63
+	unsigned long limit;	// x << 1 above this saturates to ULONG_MAX - 1
+};
+
+struct CalcPlan
+{
+	int len;
+	struct CalcStep steps[];
+};
+
+typedef unsigned long (*CalcOpFn)(unsigned long num);
+
+// The unsigned long function of the operation named prog (e.g. "./double"),
+// or NULL if it is not one.
+extern CalcOpFn CalcLookup(const char *prog);
+// Runs the chain one call per operation, clamping between them as the
+// exec'd binaries do: the unfused reference the plans are checked against.
+extern unsigned long CalcRunInterp(CalcOpFn *fns, int count, unsigned long num);
+
+// Fuses the operations named by names (program names as given to calc,
+// e.g. "./square"). Returns NULL if one of them is not an operation.
+extern struct CalcPlan *CalcCompile(char **names, int count);
+// Same results as running the chain one operation at a time.
+extern unsigned long CalcRun(const struct CalcPlan *plan, unsigned long num);
+// Runs the plan over n values in place, with AVX2 where available.
+extern void CalcRunBlock(const struct CalcPlan *plan, unsigned long *v, long n);
+extern void CalcFree(struct CalcPlan *plan);
+
+#endif
@@ -18,7 +18,7 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
-	char num_string[10];
+	char num_string[24];
 	sprintf(num_string, "%lu", num);
 
 	char *myArgs[argc];
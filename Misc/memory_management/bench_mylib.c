@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "mylib.h"
+
+// Compares memalloc/memfree against the original single-list first fit on
+// three allocation patterns:
+//   random   - a pool of slots, each op frees or fills a random slot
+//   lifo     - allocate a batch, free it in reverse order
+//   prodcons - a FIFO queue, the oldest block is freed as a new one arrives
+//
+// gcc -O2 bench_mylib.c mylib.c -o bench_mylib
+// ./bench_mylib [ops]
+
+#define POOL_SLOTS 4096
+#define LIFO_BATCH 1024
+#define QUEUE_LEN 2048
+#define MAX_REQUEST 2048
+
+///////////////////////////////////////////////////////////////////////
+/////////////// Reference: first fit over one free list ///////////////
+///////////////////////////////////////////////////////////////////////
+
+// The allocator as it was before the size-class bins, minus the printf
+// calls, with coalescing fixed to keep walking after it unlinks a node.
+struct FFNode{
+	unsigned long size;
+	struct FFNode* next;
+	struct FFNode* prev;
+	void* memory;
+};
+
+#define FF_MEMVAL sizeof(struct FFNode)
+#define FF_CHUNK (4096 * 1024)
+
+static struct FFNode ff_head;
+
+static void ff_push(struct FFNode* node)
+{
+	node->next = ff_head.next;
+	node->prev = &ff_head;
+	if (ff_head.next) ff_head.next->prev = node;
+	ff_head.next = node;
+}
+
+static void ff_unlink(struct FFNode* node)
+{
+	node->prev->next = node->next;
+	if (node->next) node->next->prev = node->prev;
+}
+
+static void *ff_alloc(unsigned long size)
+{
+	if (size == 0) return NULL;
+
+	size = size + (8 - size % 8) % 8 + sizeof(unsigned long);
+	if (size < FF_MEMVAL) size = FF_MEMVAL;
+
+	struct FFNode* ptr;
+	for (ptr = ff_head.next; ptr; ptr = ptr->next)
+		if (ptr->size >= size) break;
+
+	if (ptr == NULL)
+	{
+		unsigned long req_size = ((size + FF_CHUNK - 1) / FF_CHUNK) * FF_CHUNK;
+		ptr = mmap(NULL, req_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED){
+			perror("mmap");
+			exit(-1);
+		}
+		ptr->size = req_size;
+	}
+	else
+	{
+		ff_unlink(ptr);
+	}
+
+	if (ptr->size >= size + FF_MEMVAL)
+	{
+		struct FFNode* rest = (struct FFNode *) ((char *) ptr + size);
+		rest->size = ptr->size - size;
+		ff_push(rest);
+		ptr->size = size;
+	}
+
+	return (unsigned long *) ptr + 1;
+}
+
+static void ff_free(void *mem)
+{
+	struct FFNode* node = (struct FFNode *) ((unsigned long *) mem - 1);
+	struct FFNode* ptr = ff_head.next;
+
+	while (ptr)
+	{
+		struct FFNode* next = ptr->next;
+
+		if ((char *) node + node->size == (char *) ptr)
+		{
+			ff_unlink(ptr);
+			node->size += ptr->size;
+		}
+		else if ((char *) ptr + ptr->size == (char *) node)
+		{
+			ff_unlink(ptr);
+			ptr->size += node->size;
+			node = ptr;
+		}
+
+		ptr = next;
+	}
+
+	ff_push(node);
+}
+
+///////////////////////////////////////////////////////////////////////
+//////////////////////////////// Patterns /////////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+struct Allocator{
+	const char *name;
+	void *(*alloc)(unsigned long size);
+	void (*free)(void *ptr);
+};
+
+static void lib_free(void *ptr)
+{
+	memfree(ptr);
+}
+
+static unsigned long rng_state;
+
+static unsigned long rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static unsigned long rand_size(void)
+{
+	return 1 + rng() % MAX_REQUEST;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Every pattern touches the first byte of each block so a broken allocator
+// faults instead of looking fast.
+static void pattern_random(struct Allocator* a, long ops, void **slots)
+{
+	for (long i = 0; i < ops; i++)
+	{
+		unsigned long s = rng() % POOL_SLOTS;
+		if (slots[s])
+		{
+			a->free(slots[s]);
+			slots[s] = NULL;
+		}
+		else
+		{
+			slots[s] = a->alloc(rand_size());
+			*(char *) slots[s] = 1;
+		}
+	}
+
+	for (int s = 0; s < POOL_SLOTS; s++)
+		if (slots[s]) a->free(slots[s]);
+}
+
+static void pattern_lifo(struct Allocator* a, long ops, void **slots)
+{
+	for (long i = 0; i < ops; i += 2 * LIFO_BATCH)
+	{
+		for (int s = 0; s < LIFO_BATCH; s++)
+		{
+			slots[s] = a->alloc(rand_size());
+			*(char *) slots[s] = 1;
+		}
+		for (int s = LIFO_BATCH - 1; s >= 0; s--)
+			a->free(slots[s]);
+	}
+}
+
+static void pattern_prodcons(struct Allocator* a, long ops, void **slots)
+{
+	long head = 0, tail = 0;
+
+	for (long i = 0; i < ops; i++)
+	{
+		if (head - tail == QUEUE_LEN || (head > tail && rng() % 2))
+		{
+			a->free(slots[tail % QUEUE_LEN]);
+			tail++;
+		}
+		else
+		{
+			slots[head % QUEUE_LEN] = a->alloc(rand_size());
+			*(char *) slots[head % QUEUE_LEN] = 1;
+			head++;
+		}
+	}
+
+	for (; tail < head; tail++)
+		a->free(slots[tail % QUEUE_LEN]);
+}
+
+struct Pattern{
+	const char *name;
+	void (*run)(struct Allocator* a, long ops, void **slots);
+};
+
+int main(int argc, char *argv[])
+{
+	long ops = argc > 1 ? atol(argv[1]) : 200000;
+	if (ops <= 0){
+		fprintf(stderr, "usage: %s [ops]\n", argv[0]);
+		exit(1);
+	}
+
+	struct Allocator allocators[] = {
+		{"first-fit", ff_alloc, ff_free},
+		{"mylib", memalloc, lib_free},
+	};
+	struct Pattern patterns[] = {
+		{"random", pattern_random},
+		{"lifo", pattern_lifo},
+		{"prodcons", pattern_prodcons},
+	};
+
+	static void *slots[POOL_SLOTS];
+
+	printf("%-10s %-10s %12s\n", "pattern", "allocator", "ns/op");
+	for (int p = 0; p < 3; p++)
+	{
+		for (int a = 0; a < 2; a++)
+		{
+			// same request stream for both allocators
+			rng_state = 88172645463325252UL;
+			memset(slots, 0, sizeof(slots));
+
+			double start = now();
+			patterns[p].run(&allocators[a], ops, slots);
+			double elapsed = now() - start;
+
+			printf("%-10s %-10s %12.1f\n", patterns[p].name, allocators[a].name, elapsed * 1e9 / ops);
+		}
+	}
+
+	return 0;
+}
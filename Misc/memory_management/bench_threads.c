@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "mylib.h"
+
+// Scalability of the MYLIB_THREADS build. For 1 up to max_threads threads
+// every thread runs the same churn over a private pool of slots (mostly
+// small blocks that hit the per-thread caches, one in 64 large enough to
+// go to the shared arena) and the total ops/sec is reported.
+//
+// gcc -O2 -DMYLIB_THREADS -pthread bench_threads.c mylib.c -o bench_threads
+// ./bench_threads [max_threads] [ops_per_thread]
+
+#define POOL_SLOTS 1024
+
+struct Worker{
+	pthread_t tid;
+	long ops;
+	unsigned long seed;
+};
+
+static void *churn(void *arg)
+{
+	struct Worker* w = arg;
+	unsigned long x = w->seed;
+	void *slots[POOL_SLOTS] = {NULL};
+
+	for (long i = 0; i < w->ops; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+
+		unsigned long s = x % POOL_SLOTS;
+		if (slots[s])
+		{
+			memfree(slots[s]);
+			slots[s] = NULL;
+		}
+		else
+		{
+			unsigned long size = (x >> 32) % 64 ? 8 + (x >> 40) % 256 : 1024 + (x >> 40) % 8192;
+			slots[s] = memalloc(size);
+			*(char *) slots[s] = 1;
+		}
+	}
+
+	for (int s = 0; s < POOL_SLOTS; s++)
+		if (slots[s]) memfree(slots[s]);
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+	int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+	long ops = argc > 2 ? atol(argv[2]) : 1000000;
+	if (max_threads <= 0 || ops <= 0){
+		fprintf(stderr, "usage: %s [max_threads] [ops_per_thread]\n", argv[0]);
+		exit(1);
+	}
+
+	struct Worker* workers = calloc(max_threads, sizeof(struct Worker));
+	if (!workers){
+		perror("calloc");
+		exit(1);
+	}
+
+	printf("%8s %14s\n", "threads", "ops/sec");
+	for (int n = 1; n <= max_threads; n++)
+	{
+		double start = now();
+		for (int t = 0; t < n; t++)
+		{
+			workers[t].ops = ops;
+			workers[t].seed = 88172645463325252UL + t;
+			if (pthread_create(&workers[t].tid, NULL, churn, &workers[t])){
+				perror("pthread_create");
+				exit(1);
+			}
+		}
+		for (int t = 0; t < n; t++)
+			pthread_join(workers[t].tid, NULL);
+		double elapsed = now() - start;
+
+		printf("%8d %14.0f\n", n, n * ops / elapsed);
+	}
+
+	free(workers);
+	return 0;
+}
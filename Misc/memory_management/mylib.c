@@ -1,155 +1,713 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include "mylib.h"
 
+#ifdef MYLIB_THREADS
+#include <pthread.h>
+#endif
+
+// Every block starts with its size word. The low bits of the size carry the
+// in-use state of the block and of its left neighbour; free blocks also keep
+// a copy of their size in the last word (boundary tag) so the right
+// neighbour can find them in O(1).
 struct FreeNode{
 	unsigned long size;
 	struct FreeNode* next;
 	struct FreeNode* prev;
-	void* memory;
+	unsigned long footer;
+};
+
+#define BLOCK_INUSE 0x1UL
+#define PREV_INUSE 0x2UL
+#define BLOCK_MMAPPED 0x4UL
+#define FLAG_MASK 0x7UL
+
+#define block_size(p) ((p)->size & ~FLAG_MASK)
+#define next_block(p) ((struct FreeNode *) ((char *) (p) + block_size(p)))
+#define block_footer(p) ((unsigned long *) next_block(p) - 1)
+
+// Free blocks are kept in segregated bins. Blocks below SMALL_BIN_LIMIT get
+// one exact-size bin per 8-byte step, larger ones one bin per power of two.
+#define SMALL_BIN_LIMIT 1024
+#define NUM_BINS 192
+#define BIN_WORDS (NUM_BINS / 64)
+#define MEMVAL sizeof(struct FreeNode)
+#define CHUNK_SIZE (4096 * 1024)
+
+// Each mmapped chunk ends in a trailer whose first word is a zero-sized
+// in-use block header, so coalescing stops there. The trailer also links
+// the chunk into the list of mappings owned by the allocator.
+struct MemChunk{
+	unsigned long size;
+	unsigned long length;
+	struct MemChunk* next;
+	struct MemChunk* prev;
 };
 
-struct FreeNode head;
+#define FENCE_SIZE sizeof(struct MemChunk)
+#define chunk_base(c) ((char *) (c) + FENCE_SIZE - (c)->length)
+
+// number of completely free chunks kept mapped before returning them to the OS
+#define CHUNK_KEEP 1
+
+// requests of at least this many bytes get a private mapping of their own
+#define MMAP_THRESHOLD (1024 * 1024)
+#define PAGE_SIZE 4096
+#define page_round(x) ((x) + (PAGE_SIZE - (x) % PAGE_SIZE) % PAGE_SIZE)
+
+// With -DMYLIB_HUGEPAGES arena chunks are backed by 2 MiB pages: explicit
+// MAP_HUGETLB pages when the system has them reserved, otherwise a 2 MiB
+// aligned mapping advised for transparent huge pages.
+#define HUGE_PAGE_SIZE (2048 * 1024)
+
+struct FreeNode head[NUM_BINS];
+unsigned long bin_map[BIN_WORDS];
+
+struct MemChunk chunks;
+unsigned long empty_chunks;
+struct memstats stats;
+
+#ifdef MYLIB_THREADS
+// Built with -DMYLIB_THREADS the bins above form a shared arena behind
+// arena_mutex. Each thread additionally keeps a small LIFO cache of freed
+// blocks per small size class; cached blocks stay marked in use so the
+// arena never coalesces with them, and are only handed back to the arena
+// when a class overflows or the thread exits.
+#define TCACHE_BINS (SMALL_BIN_LIMIT / 8)
+#define TCACHE_COUNT 16
+
+struct ThreadCache{
+	struct FreeNode* bins[TCACHE_BINS];
+	int count[TCACHE_BINS];
+	int registered;
+};
+
+pthread_mutex_t arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct ThreadCache tcache;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+#define arena_lock() pthread_mutex_lock(&arena_mutex)
+#define arena_unlock() pthread_mutex_unlock(&arena_mutex)
+#else
+#define arena_lock()
+#define arena_unlock()
+#endif
 
-void *memalloc(unsigned long size) 
+#ifdef MYLIB_TRACE
+// Built with -DMYLIB_TRACE every call is recorded into a preallocated ring
+// that memtrace_read() copies out; otherwise trace_event() compiles away.
+#define MEMTRACE_SIZE 65536
+
+static struct memtrace_event trace_ring[MEMTRACE_SIZE];
+static unsigned long trace_pos;
+
+static void memtrace(unsigned long type, unsigned long size, void *addr)
 {
+	unsigned long seq = __atomic_fetch_add(&trace_pos, 1, __ATOMIC_RELAXED);
+	struct memtrace_event* event = &trace_ring[seq % MEMTRACE_SIZE];
 
-	printf("memalloc() called\n");
-	if (size == 0) return NULL;
+	event->type = type;
+	event->size = size;
+	event->addr = addr;
+	__atomic_store_n(&event->seq, seq, __ATOMIC_RELEASE);
+}
 
-	head.size = 0;
-	head.prev = NULL;
+#define trace_event(type, size, addr) memtrace(type, size, addr)
+#else
+#define trace_event(type, size, addr) ((void) (size))
+#endif
 
-	struct FreeNode* ptr_prev = &head;
-	struct FreeNode* ptr = ptr_prev->next;
-	unsigned long MEMVAL = sizeof(unsigned long) + 2 * sizeof(struct FreeNode *);
+static int bin_index(unsigned long size)
+{
+	if (size < SMALL_BIN_LIMIT) return size / 8;
+	return SMALL_BIN_LIMIT / 8 + (63 - __builtin_clzl(size)) - __builtin_ctzl(SMALL_BIN_LIMIT);
+}
 
-	size = size + (8 - size % 8) % 8 + sizeof(unsigned long);
-	if(size < MEMVAL) size = MEMVAL;
+static void insert_node(struct FreeNode* node)
+{
+	int bin = bin_index(block_size(node));
 
-	while(ptr){
+	node->next = head[bin].next;
+	node->prev = &head[bin];
+	* block_footer(node) = block_size(node);
 
-		if (ptr->size >= size)
-		{
-			struct FreeNode* next_ptr = ptr->next;
-
-			if(ptr->size < size + MEMVAL)
-			{
-				if (next_ptr) next_ptr->prev = ptr_prev;
-				ptr_prev->next = next_ptr;	
-			}
-
-			else
-			{
-				struct FreeNode* new_free_node = (struct FreeNode *) ((char *) ptr + size);
-
-				if (next_ptr) next_ptr->prev = ptr_prev;
-				ptr_prev->next = next_ptr;	
-
-				new_free_node->size = ptr->size - size;
-				new_free_node->next = (&head)->next;
-				new_free_node->prev = (&head);
-				new_free_node->memory = (void *) ((char *) ptr + size + sizeof(unsigned long) + 2 * sizeof(struct FreeNode *));
-				
-				if(head.next)
-				{
-					head.next->prev = new_free_node;
-				}
-				(&head)->next = new_free_node;
-
-				* (unsigned long *) ptr = size;
-			}
-
-			void* ret_mem = (unsigned long *) ptr + 1;
-			return ret_mem;
-		}
+	if (head[bin].next) head[bin].next->prev = node;
+	head[bin].next = node;
+	bin_map[bin / 64] |= 1UL << (bin % 64);
+	stats.free_blocks++;
+}
 
-		else
-		{
-			ptr_prev = ptr_prev->next;
-			ptr = ptr->next;
-		} 
+static void remove_node(struct FreeNode* node)
+{
+	int bin = bin_index(block_size(node));
+
+	node->prev->next = node->next;
+	if (node->next) node->next->prev = node->prev;
+	if (head[bin].next == NULL) bin_map[bin / 64] &= ~(1UL << (bin % 64));
+	stats.free_blocks--;
+}
+
+// first non-empty bin at or after bin, -1 if there is none
+static int next_bin(int bin)
+{
+	int word = bin / 64;
+	if (word >= BIN_WORDS) return -1;
+
+	unsigned long bits = bin_map[word] & (~0UL << (bin % 64));
+	while (bits == 0)
+	{
+		if (++word == BIN_WORDS) return -1;
+		bits = bin_map[word];
 	}
 
-	if (ptr == NULL)
+	return word * 64 + __builtin_ctzl(bits);
+}
+
+static void arena_free(struct FreeNode* new_node);
+
+static struct FreeNode* find_fit(unsigned long size)
+{
+	int bin = bin_index(size);
+
+	// power-of-two bins hold mixed sizes, so only this one needs a first-fit scan
+	if (size >= SMALL_BIN_LIMIT)
 	{
+		for (struct FreeNode* ptr = head[bin].next; ptr; ptr = ptr->next)
+			if (block_size(ptr) >= size) return ptr;
+		bin++;
+	}
+
+	// every block in a higher bin is large enough
+	bin = next_bin(bin);
+	if (bin < 0) return NULL;
+	return head[bin].next;
+}
+
+// chunk trailer if node is the only block of its chunk, NULL otherwise
+static struct MemChunk* empty_chunk(struct FreeNode* node)
+{
+	struct FreeNode* next = next_block(node);
+	if (block_size(next) != 0) return NULL;
+
+	struct MemChunk* chunk = (struct MemChunk *) next;
+	if (chunk_base(chunk) != (char *) node) return NULL;
+	return chunk;
+}
+
+static char* map_chunk(unsigned long req_size)
+{
+#ifdef MYLIB_HUGEPAGES
+	char *mem = mmap(NULL, req_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+	if (mem != MAP_FAILED) return mem;
+
+	mem = mmap(NULL, req_size + HUGE_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED){
+		perror("mmap");
+		exit(-1);
+	}
+
+	// trim the over-mapping so the chunk starts on a huge page boundary
+	unsigned long lead = (HUGE_PAGE_SIZE - (unsigned long) mem % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+	if (lead) munmap(mem, lead);
+	munmap(mem + lead + req_size, HUGE_PAGE_SIZE - lead);
+	mem += lead;
+
+	madvise(mem, req_size, MADV_HUGEPAGE);
+	return mem;
+#else
+	char *mem = mmap(NULL, req_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED){
+		perror("mmap");
+		exit(-1);
+	}
+	return mem;
+#endif
+}
+
+static struct FreeNode* new_chunk(unsigned long size)
+{
+	unsigned long req_size = ((size + FENCE_SIZE) / CHUNK_SIZE) * CHUNK_SIZE;
+	if ((size + FENCE_SIZE) % CHUNK_SIZE) req_size += CHUNK_SIZE;
+
+	char *mem = map_chunk(req_size);
+
+	struct FreeNode* ptr = (struct FreeNode *) mem;
+	ptr->size = (req_size - FENCE_SIZE) | PREV_INUSE;
+
+	struct MemChunk* chunk = (struct MemChunk *) next_block(ptr);
+	chunk->size = BLOCK_INUSE;
+	chunk->length = req_size;
+	chunk->next = chunks.next;
+	chunk->prev = &chunks;
+	if (chunks.next) chunks.next->prev = chunk;
+	chunks.next = chunk;
+
+	stats.mapped_bytes += req_size;
+	stats.chunks++;
+	return ptr;
+}
+
+static void release_chunk(struct MemChunk* chunk)
+{
+	chunk->prev->next = chunk->next;
+	if (chunk->next) chunk->next->prev = chunk->prev;
 
-		unsigned long req_size = (size / (4096 * 1024))*(4096 * 1024);
-		if (size % (4096 * 1024)) req_size += 4096 * 1024;
+	stats.mapped_bytes -= chunk->length;
+	stats.chunks--;
 
-		char *mem = mmap(NULL, req_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-		if(mem == MAP_FAILED){
-			perror("mmap");
-			exit(-1);
+	if (munmap(chunk_base(chunk), chunk->length) < 0){
+		perror("munmap");
+		exit(-1);
+	}
+}
+
+// *fresh is set when the block comes from a newly mapped, still zeroed chunk
+static struct FreeNode* arena_alloc(unsigned long size, int *fresh)
+{
+	struct FreeNode* ptr = find_fit(size);
+
+	if (ptr)
+	{
+		if (empty_chunk(ptr)) empty_chunks--;
+		remove_node(ptr);
+		*fresh = 0;
+	}
+
+	else
+	{
+		ptr = new_chunk(size);
+		*fresh = 1;
+	}
+
+	unsigned long ptr_size = block_size(ptr);
+
+	if(ptr_size >= size + MEMVAL)
+	{
+		struct FreeNode* new_free_node = (struct FreeNode *) ((char *) ptr + size);
+		new_free_node->size = (ptr_size - size) | PREV_INUSE;
+		insert_node(new_free_node);
+
+		ptr->size = size | (ptr->size & PREV_INUSE);
+	}
+
+	else
+	{
+		next_block(ptr)->size |= PREV_INUSE;
+	}
+
+	ptr->size |= BLOCK_INUSE;
+	stats.inuse_bytes += block_size(ptr);
+	return ptr;
+}
+
+// Grows or shrinks an in-use arena block in place. Growth only succeeds
+// when the right neighbour is free and large enough; any surplus of at
+// least MEMVAL bytes is split off and returned to the bins.
+static int arena_resize(struct FreeNode* ptr, unsigned long size)
+{
+	unsigned long curr_sz = block_size(ptr);
+	struct FreeNode* right = next_block(ptr);
+
+	if (size > curr_sz)
+	{
+		if (right->size & BLOCK_INUSE) return -1;
+		if (curr_sz + block_size(right) < size) return -1;
+
+		remove_node(right);
+		curr_sz += block_size(right);
+		stats.inuse_bytes += block_size(right);
+		ptr->size = curr_sz | (ptr->size & FLAG_MASK);
+		next_block(ptr)->size |= PREV_INUSE;
+	}
+
+	if (curr_sz >= size + MEMVAL)
+	{
+		struct FreeNode* tail = (struct FreeNode *) ((char *) ptr + size);
+		tail->size = (curr_sz - size) | PREV_INUSE | BLOCK_INUSE;
+		ptr->size = size | (ptr->size & FLAG_MASK);
+		arena_free(tail);
+	}
+
+	return 0;
+}
+
+static void arena_free(struct FreeNode* new_node)
+{
+	unsigned long curr_sz = block_size(new_node);
+	stats.inuse_bytes -= curr_sz;
+
+	// right contigious node
+	struct FreeNode* right = next_block(new_node);
+	if (right->size & BLOCK_INUSE)
+	{
+		right->size &= ~PREV_INUSE;
+	}
+	else
+	{
+		remove_node(right);
+		curr_sz += block_size(right);
+	}
+
+	// left contigious node
+	if (!(new_node->size & PREV_INUSE))
+	{
+		unsigned long left_sz = * ((unsigned long *) new_node - 1);
+		new_node = (struct FreeNode *) ((char *) new_node - left_sz);
+		remove_node(new_node);
+		curr_sz += left_sz;
+	}
+
+	// the left neighbour of a free block is never free
+	new_node->size = curr_sz | PREV_INUSE;
+
+	struct MemChunk* chunk = empty_chunk(new_node);
+	if (chunk)
+	{
+		if (empty_chunks >= CHUNK_KEEP)
+		{
+			release_chunk(chunk);
+			return;
 		}
+		empty_chunks++;
+	}
+
+	insert_node(new_node);
+}
+
+// A directly mapped block places its header so that the user pointer is
+// aligned to align; the mapping starts on the page holding the header and
+// the header size word records the whole mapping length.
+#define mapping_base(p) ((char *) ((unsigned long) (p) & ~(unsigned long) (PAGE_SIZE - 1)))
+
+static struct FreeNode* mmap_alloc(unsigned long size, unsigned long align)
+{
+	unsigned long over = align > PAGE_SIZE ? align : 0;
+	unsigned long map_size = page_round(size + align);
+
+	char *mem = mmap(NULL, map_size + over, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED){
+		perror("mmap");
+		exit(-1);
+	}
 
-		* (unsigned long *) mem = size;
-		void* ret_mem = (unsigned long *) mem + 1;
+	unsigned long user = ((unsigned long) mem + sizeof(unsigned long) + align - 1) & ~(align - 1);
+	struct FreeNode* ptr = (struct FreeNode *) (user - sizeof(unsigned long));
+	char *base = mapping_base(ptr);
+	unsigned long req_size = page_round((char *) ptr - base + size);
 
-		struct FreeNode* new_free_mem = (struct FreeNode*) ((char *) mem + size);
-		new_free_mem->size = req_size - size;
-		new_free_mem->next = head.next;
-		new_free_mem->prev = (&head);
-		new_free_mem->memory = (void *) ((char *) mem + size + sizeof(unsigned long) + 2 * sizeof(struct FreeNode *));
+	if (base > mem) munmap(mem, base - mem);
+	if (base + req_size < mem + map_size + over) munmap(base + req_size, mem + map_size + over - base - req_size);
 
-		if(head.next)
+	ptr->size = req_size | BLOCK_MMAPPED | BLOCK_INUSE;
+
+	arena_lock();
+	stats.mapped_bytes += req_size;
+	stats.inuse_bytes += req_size;
+	stats.mmapped_blocks++;
+	arena_unlock();
+
+	return ptr;
+}
+
+static void mmap_free(struct FreeNode* ptr)
+{
+	unsigned long length = block_size(ptr);
+
+	arena_lock();
+	stats.mapped_bytes -= length;
+	stats.inuse_bytes -= length;
+	stats.mmapped_blocks--;
+	arena_unlock();
+
+	if (munmap(mapping_base(ptr), length) < 0){
+		perror("munmap");
+		exit(-1);
+	}
+}
+
+static int mmap_resize(struct FreeNode* ptr, unsigned long size)
+{
+	char *base = mapping_base(ptr);
+	unsigned long length = block_size(ptr);
+	unsigned long req_size = page_round((char *) ptr - base + size);
+
+	if (req_size == length) return 0;
+	if (mremap(base, length, req_size, 0) == MAP_FAILED) return -1;
+
+	ptr->size = req_size | BLOCK_MMAPPED | BLOCK_INUSE;
+
+	arena_lock();
+	stats.mapped_bytes += req_size - length;
+	stats.inuse_bytes += req_size - length;
+	arena_unlock();
+
+	return 0;
+}
+
+#ifdef MYLIB_THREADS
+static void tcache_flush(void *arg)
+{
+	struct ThreadCache* cache = arg;
+
+	arena_lock();
+	for (int bin = 0; bin < TCACHE_BINS; bin++)
+	{
+		while (cache->bins[bin])
 		{
-			head.next->prev = new_free_mem;
+			struct FreeNode* node = cache->bins[bin];
+			cache->bins[bin] = node->next;
+			arena_free(node);
 		}
-		head.next = new_free_mem;
+		cache->count[bin] = 0;
+	}
+	arena_unlock();
+}
+
+static void tcache_init(void)
+{
+	pthread_key_create(&tcache_key, tcache_flush);
+}
+
+static void tcache_register(void)
+{
+	pthread_once(&tcache_once, tcache_init);
+	pthread_setspecific(tcache_key, &tcache);
+	tcache.registered = 1;
+}
+#endif
+
+static unsigned long request_size(unsigned long size)
+{
+	size = size + (8 - size % 8) % 8 + sizeof(unsigned long);
+	if(size < MEMVAL) size = MEMVAL;
+	return size;
+}
 
-		return ret_mem;
+static struct FreeNode* get_block(unsigned long size, int *fresh)
+{
+	struct FreeNode* ptr;
+
+#ifdef MYLIB_THREADS
+	if (size < SMALL_BIN_LIMIT && tcache.bins[size / 8])
+	{
+		ptr = tcache.bins[size / 8];
+		tcache.bins[size / 8] = ptr->next;
+		tcache.count[size / 8]--;
+		*fresh = 0;
+		return ptr;
 	}
+#endif
+
+	if (size >= MMAP_THRESHOLD)
+	{
+		*fresh = 1;
+		return mmap_alloc(size, sizeof(unsigned long));
+	}
+
+	arena_lock();
+	ptr = arena_alloc(size, fresh);
+	arena_unlock();
 
-	return NULL;
+	return ptr;
+}
+
+static void put_block(struct FreeNode* ptr)
+{
+	if (ptr->size & BLOCK_MMAPPED)
+	{
+		mmap_free(ptr);
+		return;
+	}
+
+#ifdef MYLIB_THREADS
+	unsigned long curr_sz = block_size(ptr);
+	if (curr_sz < SMALL_BIN_LIMIT && tcache.count[curr_sz / 8] < TCACHE_COUNT)
+	{
+		if (!tcache.registered) tcache_register();
+		ptr->next = tcache.bins[curr_sz / 8];
+		tcache.bins[curr_sz / 8] = ptr;
+		tcache.count[curr_sz / 8]++;
+		return;
+	}
+#endif
+
+	arena_lock();
+	arena_free(ptr);
+	arena_unlock();
+}
+
+void *memalloc(unsigned long size)
+{
+	if (size == 0) return NULL;
+
+	int fresh;
+	struct FreeNode* ptr = get_block(request_size(size), &fresh);
+
+	void* ret_mem = (unsigned long *) ptr + 1;
+	trace_event(MEMTRACE_ALLOC, size, ret_mem);
+	return ret_mem;
 }
 
 int memfree(void *ptr)
 {
-	unsigned long curr_sz = * ((unsigned long *) ptr - 1);
 	struct FreeNode* new_node = (struct FreeNode *)((unsigned long *) ptr - 1);
+	trace_event(MEMTRACE_FREE, block_size(new_node), ptr);
 
-	struct FreeNode* start = (struct FreeNode *) ((unsigned long *) ptr - 1);
-	struct FreeNode* end = (struct FreeNode*) ((char *) start + curr_sz);
-	
-	struct FreeNode* prev_ptr = &head;
-	struct FreeNode* curr_ptr = prev_ptr->next;
+	put_block(new_node);
+	return 0;
+}
+
+void *memalloc_aligned(unsigned long alignment, unsigned long size)
+{
+	if (size == 0) return NULL;
+	if (alignment & (alignment - 1)) return NULL;
+	if (alignment <= sizeof(unsigned long)) return memalloc(size);
 
-	new_node->size = curr_sz;
-	new_node->prev = &head;
-	new_node->next = NULL;
-	new_node->memory = (void *)((struct FreeNode **) ptr + 2);
+	unsigned long req_size = request_size(size);
+	struct FreeNode* ptr;
 
-	while(curr_ptr)
+	// the arena path carves req_size + alignment + MEMVAL, so that is what
+	// decides whether the block would pollute the bins
+	if (alignment >= MMAP_THRESHOLD || req_size + alignment + MEMVAL >= MMAP_THRESHOLD)
 	{
-		struct FreeNode* next_ptr = curr_ptr->next;
+		ptr = mmap_alloc(req_size, alignment);
+	}
+	else
+	{
+		int fresh;
 
-		// right contigious node
-		if (curr_ptr == end)
-		{
-			new_node->size = new_node->size + curr_ptr->size;
-			prev_ptr->next = next_ptr;
-			if(next_ptr) next_ptr->prev = prev_ptr;
-		}
+		arena_lock();
+		struct FreeNode* lead = arena_alloc(req_size + alignment + MEMVAL, &fresh);
 
-		// left contigious node
-		struct FreeNode* curr_end = (struct FreeNode *) ((char *) curr_ptr + curr_ptr->size);
-		if(curr_end == start)
+		// the skipped prefix must be empty or big enough to be a free block
+		unsigned long user = ((unsigned long) lead + sizeof(unsigned long) + alignment - 1) & ~(alignment - 1);
+		while (user - sizeof(unsigned long) != (unsigned long) lead && user - sizeof(unsigned long) - (unsigned long) lead < MEMVAL)
+			user += alignment;
+		ptr = (struct FreeNode *) (user - sizeof(unsigned long));
+
+		if (ptr != lead)
 		{
-			new_node->size = new_node->size + curr_ptr->size;
-			new_node->memory = curr_ptr->memory;
-			prev_ptr->next = next_ptr;
-			if(next_ptr) next_ptr->prev = prev_ptr;
+			unsigned long gap = (char *) ptr - (char *) lead;
+			ptr->size = (block_size(lead) - gap) | PREV_INUSE | BLOCK_INUSE;
+			lead->size = gap | (lead->size & PREV_INUSE) | BLOCK_INUSE;
+			arena_free(lead);
 		}
 
-		curr_ptr = curr_ptr->next;
-		prev_ptr = prev_ptr->next;
+		arena_resize(ptr, req_size);
+		arena_unlock();
 	}
 
-	head.next->prev = new_node;
-	new_node->next = head.next;
-	head.next = new_node;
+	void* ret_mem = (unsigned long *) ptr + 1;
+	trace_event(MEMTRACE_ALLOC, size, ret_mem);
+	return ret_mem;
+}
+
+void *memcalloc(unsigned long nmemb, unsigned long size)
+{
+	if (nmemb == 0 || size == 0) return NULL;
+	if (nmemb > (unsigned long) -1 / size) return NULL;
+
+	int fresh;
+	struct FreeNode* ptr = get_block(request_size(nmemb * size), &fresh);
+
+	// freshly mapped pages are already zero
+	void* ret_mem = (unsigned long *) ptr + 1;
+	if (!fresh) memset(ret_mem, 0, block_size(ptr) - sizeof(unsigned long));
+
+	trace_event(MEMTRACE_ALLOC, nmemb * size, ret_mem);
+	return ret_mem;
+}
+
+void *memrealloc(void *ptr, unsigned long size)
+{
+	if (ptr == NULL) return memalloc(size);
+	if (size == 0)
+	{
+		memfree(ptr);
+		return NULL;
+	}
+
+	struct FreeNode* node = (struct FreeNode *)((unsigned long *) ptr - 1);
+	unsigned long curr_sz = block_size(node);
+	unsigned long req_size = request_size(size);
+	int resized;
+
+	if (node->size & BLOCK_MMAPPED)
+	{
+		resized = req_size >= MMAP_THRESHOLD ? mmap_resize(node, req_size) : -1;
+	}
+	else if (req_size >= MMAP_THRESHOLD)
+	{
+		resized = -1;
+	}
+	else
+	{
+		arena_lock();
+		resized = arena_resize(node, req_size);
+		arena_unlock();
+	}
+
+	if (resized == 0)
+	{
+		trace_event(MEMTRACE_FREE, curr_sz, ptr);
+		trace_event(MEMTRACE_ALLOC, size, ptr);
+		return ptr;
+	}
+
+	// an aligned mapping may place the header partway into its first page
+	void* ret_mem = memalloc(size);
+	unsigned long copy_sz = curr_sz - sizeof(unsigned long);
+	if (node->size & BLOCK_MMAPPED) copy_sz = mapping_base(node) + curr_sz - (char *) ptr;
+	if (copy_sz > size) copy_sz = size;
+	memcpy(ret_mem, ptr, copy_sz);
+	memfree(ptr);
+
+	return ret_mem;
+}
+
+int memstats(struct memstats *st)
+{
+	if (st == NULL) return -1;
+
+	arena_lock();
+	*st = stats;
+
+	// the highest non-empty bin holds the largest block
+	st->largest_free = 0;
+	for (int bin = NUM_BINS - 1; bin >= 0; bin--)
+	{
+		if (!(bin_map[bin / 64] & (1UL << (bin % 64)))) continue;
+		for (struct FreeNode* ptr = head[bin].next; ptr; ptr = ptr->next)
+			if (block_size(ptr) > st->largest_free) st->largest_free = block_size(ptr);
+		break;
+	}
+	arena_unlock();
 
-	printf("memfree() called\n");
 	return 0;
-}	
\ No newline at end of file
+}
+
+#ifdef MYLIB_TRACE
+unsigned long memtrace_read(struct memtrace_event *buf, unsigned long count)
+{
+	unsigned long end = __atomic_load_n(&trace_pos, __ATOMIC_ACQUIRE);
+	unsigned long start = end > MEMTRACE_SIZE ? end - MEMTRACE_SIZE : 0;
+	unsigned long copied = 0;
+
+	if (end - start > count) start = end - count;
+
+	for (unsigned long seq = start; seq < end; seq++)
+	{
+		struct memtrace_event* event = &trace_ring[seq % MEMTRACE_SIZE];
+
+		// skip slots a concurrent writer has not finished publishing
+		if (__atomic_load_n(&event->seq, __ATOMIC_ACQUIRE) != seq) continue;
+		buf[copied++] = *event;
+	}
+
+	return copied;
+}
+#endif
@@ -0,0 +1,43 @@
+#ifndef __MYLIB_H_
+#define __MYLIB_H_
+
+// Heap footprint snapshot filled in by memstats(). Byte counts include the
+// 8-byte block headers; blocks held in per-thread caches count as in use.
+// Large allocations served by their own mapping appear in mapped_bytes and
+// inuse_bytes and are counted in mmapped_blocks rather than chunks.
+struct memstats
+{
+	unsigned long mapped_bytes;
+	unsigned long inuse_bytes;
+	unsigned long free_blocks;
+	unsigned long largest_free;
+	unsigned long chunks;
+	unsigned long mmapped_blocks;
+};
+
+#ifdef MYLIB_TRACE
+#define MEMTRACE_ALLOC 1
+#define MEMTRACE_FREE 2
+
+// One allocator event. size is the requested size for MEMTRACE_ALLOC and
+// the block size for MEMTRACE_FREE; seq orders events across threads.
+struct memtrace_event
+{
+	unsigned long seq;
+	unsigned long type;
+	unsigned long size;
+	void *addr;
+};
+
+// Copies up to count of the most recent events, oldest first.
+extern unsigned long memtrace_read(struct memtrace_event *buf, unsigned long count);
+#endif
+
+extern void *memalloc(unsigned long size);
+extern int memfree(void *ptr);
+extern void *memcalloc(unsigned long nmemb, unsigned long size);
+extern void *memrealloc(void *ptr, unsigned long size);
+extern void *memalloc_aligned(unsigned long alignment, unsigned long size);
+extern int memstats(struct memstats *st);
+
+#endif
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "mylib.h"
+
+// Checks that memfree stays O(1) as the heap grows. For every heap size
+// from 16K up to max_blocks blocks (doubling) it allocates the blocks,
+// frees every other one so the free lists hold one fragment per live
+// block, then times freeing the rest, each free coalescing with both
+// neighbours. ns/free should not grow with the heap.
+//
+// The survivors are freed in random order within consecutive batches of
+// BATCH blocks, so the timing measures the allocator rather than cache
+// misses spread over the whole heap. The worst batch includes the munmap
+// of chunks that become empty.
+//
+// gcc -O2 stress_memfree.c mylib.c -o stress_memfree
+// ./stress_memfree [max_blocks]
+
+#define MIN_BLOCKS (16 * 1024)
+#define BATCH 1024
+
+static unsigned long rng_state = 88172645463325252UL;
+
+static unsigned long rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+	long max_blocks = argc > 1 ? atol(argv[1]) : 4 * 1024 * 1024;
+	if (max_blocks < MIN_BLOCKS){
+		fprintf(stderr, "usage: %s [max_blocks >= %d]\n", argv[0], MIN_BLOCKS);
+		exit(1);
+	}
+
+	void **blocks = malloc(max_blocks * sizeof(void *));
+	long *order = malloc(max_blocks / 2 * sizeof(long));
+	if (!blocks || !order){
+		perror("malloc");
+		exit(1);
+	}
+
+	printf("%10s %12s %12s %16s\n", "blocks", "free_blocks", "ns/free", "worst ns/free");
+	for (long n = MIN_BLOCKS; n <= max_blocks; n *= 2)
+	{
+		for (long i = 0; i < n; i++)
+			blocks[i] = memalloc(16 + rng() % 112);
+		for (long i = 0; i < n; i += 2)
+			memfree(blocks[i]);
+
+		struct memstats st;
+		memstats(&st);
+
+		// survivors, shuffled within each batch
+		long m = n / 2;
+		for (long i = 0; i < m; i++)
+			order[i] = 2 * i + 1;
+		for (long i = m - 1; i > 0; i--)
+		{
+			if (i % BATCH == 0) continue;
+			long j = i - i % BATCH + rng() % (i % BATCH + 1);
+			long t = order[i];
+			order[i] = order[j];
+			order[j] = t;
+		}
+
+		double total = 0, worst = 0;
+		for (long i = 0; i < m; i += BATCH)
+		{
+			long end = i + BATCH < m ? i + BATCH : m;
+			double start = now();
+			for (long k = i; k < end; k++)
+				memfree(blocks[order[k]]);
+			double elapsed = now() - start;
+
+			total += elapsed;
+			if (elapsed / (end - i) > worst) worst = elapsed / (end - i);
+		}
+
+		printf("%10ld %12lu %12.1f %16.1f\n", n, st.free_blocks, total * 1e9 / m, worst * 1e9);
+	}
+
+	free(blocks);
+	free(order);
+	return 0;
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mylib.h"
+
+// Randomized alloc/aligned/calloc/realloc/free stress for mylib. Every live
+// block is filled with a byte derived from its slot and checked before it
+// is resized or freed, so a bad copy or an overlapping block shows up as a
+// mismatch. Fixed cases first cover realloc of large aligned blocks,
+// whose header sits partway into the first page of their mapping, and
+// small blocks whose alignment alone puts them past the mmap threshold.
+//
+// gcc -O2 test_mylib.c mylib.c -o test_mylib
+// ./test_mylib [ops]
+
+#define SLOTS 256
+
+struct Slot{
+	unsigned char *ptr;
+	unsigned long size;
+	unsigned char fill;
+};
+
+static unsigned long rng_state = 88172645463325252UL;
+
+static unsigned long rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+// mostly arena sizes, some around and above the mmap threshold
+static unsigned long rand_size(void)
+{
+	switch (rng() % 8)
+	{
+	case 0: return 1 + rng() % (4 << 20);
+	case 1: return (1 << 20) - 64 + rng() % 128;
+	default: return 1 + rng() % 4096;
+	}
+}
+
+static void fail(const char *what, long op)
+{
+	fprintf(stderr, "op %ld: %s\n", op, what);
+	exit(1);
+}
+
+static void check(struct Slot* s, unsigned long len, long op)
+{
+	for (unsigned long i = 0; i < len; i++)
+		if (s->ptr[i] != s->fill) fail("contents changed", op);
+}
+
+static void aligned_realloc(void)
+{
+	unsigned long sizes[] = {2 << 20, 1 << 20, 3 << 20};
+	unsigned long aligns[] = {16, 4096, 1 << 16, 2 << 20};
+
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			unsigned char *p = memalloc_aligned(aligns[j], sizes[i]);
+			if ((unsigned long) p % aligns[j]) fail("misaligned block", -1);
+			memset(p, 0x5a, sizes[i]);
+
+			// grow past what mremap can do in place, then shrink into the arena
+			p = memrealloc(p, 8 << 20);
+			for (unsigned long k = 0; k < sizes[i]; k++)
+				if (p[k] != 0x5a) fail("aligned realloc lost data", -1);
+
+			p = memrealloc(p, 100);
+			for (unsigned long k = 0; k < 100; k++)
+				if (p[k] != 0x5a) fail("aligned shrink lost data", -1);
+			memfree(p);
+		}
+	}
+}
+
+// small blocks with large alignments must be mapped, not carved from the
+// arena, and unmapped again on free
+static void aligned_large(void)
+{
+	unsigned long aligns[] = {1 << 20, 1 << 21, 1 << 26};
+	struct memstats before, st;
+
+	memstats(&before);
+	for (int i = 0; i < 3; i++)
+	{
+		unsigned char *p = memalloc_aligned(aligns[i], 64);
+		if ((unsigned long) p % aligns[i]) fail("misaligned block", -1);
+		memset(p, 0x5a, 64);
+
+		memstats(&st);
+		if (st.mmapped_blocks != before.mmapped_blocks + 1) fail("large aligned block not mapped", -1);
+		if (st.chunks != before.chunks) fail("large aligned block grew the arena", -1);
+
+		memfree(p);
+		memstats(&st);
+		if (st.mmapped_blocks != before.mmapped_blocks || st.mapped_bytes != before.mapped_bytes)
+			fail("large aligned block not unmapped on free", -1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	long ops = argc > 1 ? atol(argv[1]) : 20000;
+	struct Slot slots[SLOTS] = {{NULL, 0, 0}};
+
+	aligned_realloc();
+	aligned_large();
+
+	for (long op = 0; op < ops; op++)
+	{
+		struct Slot* s = &slots[rng() % SLOTS];
+		unsigned long size = rand_size();
+
+		if (s->ptr == NULL)
+		{
+			unsigned long kind = rng() % 3;
+			unsigned long align = 16UL << rng() % 12;
+
+			if (kind == 0) s->ptr = memalloc(size);
+			else if (kind == 1) s->ptr = memcalloc(1, size);
+			else s->ptr = memalloc_aligned(align, size);
+
+			if (kind == 1)
+				for (unsigned long i = 0; i < size; i++)
+					if (s->ptr[i]) fail("memcalloc block not zeroed", op);
+			if (kind == 2 && (unsigned long) s->ptr % align) fail("misaligned block", op);
+
+			s->size = size;
+			s->fill = op;
+			memset(s->ptr, s->fill, size);
+			continue;
+		}
+
+		check(s, s->size, op);
+		if (rng() % 2)
+		{
+			memfree(s->ptr);
+			s->ptr = NULL;
+			continue;
+		}
+
+		s->ptr = memrealloc(s->ptr, size);
+		check(s, size < s->size ? size : s->size, op);
+		s->size = size;
+		memset(s->ptr, s->fill, size);
+	}
+
+	for (int i = 0; i < SLOTS; i++)
+	{
+		if (!slots[i].ptr) continue;
+		check(&slots[i], slots[i].size, ops);
+		memfree(slots[i].ptr);
+	}
+
+	struct memstats st;
+	memstats(&st);
+	if (st.mmapped_blocks) fail("mapped blocks leaked", ops);
+
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <context.h>
+#include <file.h>
+#include <tracer.h>
+
+// Trace buffer copy throughput. For each transfer size it writes one
+// transfer and reads it back, over and over, through the read()/write()
+// file operations of the largest buffer, and reports MB/s for each
+// direction. Small transfers are dominated by the per-record work
+// (timestamp, header, counters), large ones by the ring copy itself.
+//
+// gcc -O2 -I host/include -I . host/bench_trace.c host/kstub.c tracer.c -o bench_trace
+// ./bench_trace [MB per size]
+
+double Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+	long mb = argc > 1 ? atol(argv[1]) : 256;
+	if (mb <= 0)
+	{
+		fprintf(stderr, "usage: %s [MB per size]\n", argv[0]);
+		exit(1);
+	}
+
+	struct exec_context *current = get_current_ctx();
+	int fd = sys_create_sized_trace_buffer(current, O_RDWR, TRACE_BUFFER_MAX_SIZE);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Unable to create the trace buffer\n");
+		exit(1);
+	}
+	struct file *filep = current->files[fd];
+
+	u32 sizes[] = { 8, 64, 512, 4096, 65536, 262144 };
+	char *in = malloc(sizes[5]), *out = malloc(sizes[5]);
+	if (!in || !out)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+	memset(in, 0x5a, sizes[5]);
+
+	printf("%10s %12s %12s\n", "bytes", "write MB/s", "read MB/s");
+	for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+	{
+		u32 size = sizes[s];
+		long reps = (mb << 20) / size;
+		double wtime = 0, rtime = 0;
+
+		// batches of transfers, so each timer read covers many copies
+		long batch = (TRACE_BUFFER_MAX_SIZE / 2) / (size + sizeof(struct trace_record));
+		for (long done = 0; done < reps; done += batch)
+		{
+			long n = reps - done < batch ? reps - done : batch;
+
+			double start = Now();
+			for (long i = 0; i < n; i++)
+				if (filep->fops->write(filep, in, size) != (int)size)
+				{
+					fprintf(stderr, "%u: short write\n", size);
+					exit(1);
+				}
+			double mid = Now();
+			for (long i = 0; i < n; i++)
+				if (filep->fops->read(filep, out, size) != (int)size)
+				{
+					fprintf(stderr, "%u: short read\n", size);
+					exit(1);
+				}
+			wtime += mid - start;
+			rtime += Now() - mid;
+		}
+
+		double bytes = (double)reps * size / (1 << 20);
+		printf("%10u %12.0f %12.0f\n", size, bytes / wtime, bytes / rtime);
+	}
+
+	filep->fops->close(filep);
+	free(in);
+	free(out);
+	return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef __CONTEXT_H_
+#define __CONTEXT_H_
+
+#include <types.h>
+
+#define MAX_OPEN_FILES 16
+
+struct mm_segment
+{
+	u64 start;
+	u64 end;
+	u64 next_free;
+	u32 access_flags;
+};
+
+struct vm_area
+{
+	u64 vm_start;
+	u64 vm_end;
+	u32 access_flags;
+	struct vm_area *vm_next;
+};
+
+struct file;
+struct strace_head;
+struct ftrace_head;
+
+struct exec_context
+{
+	u32 pid;
+	u64 pgd;
+	struct mm_segment mms[4];
+	struct vm_area *vm_area;
+	struct file *files[MAX_OPEN_FILES];
+	struct strace_head *st_md_base;
+	struct ftrace_head *ft_md_base;
+};
+
+struct user_regs
+{
+	u64 entry_rip;
+	u64 entry_rsp;
+	u64 rbp;
+	u64 rdi;
+	u64 rsi;
+	u64 rdx;
+	u64 rcx;
+	u64 r8;
+	u64 r9;
+};
+
+extern struct exec_context *get_current_ctx(void);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __ENTRY_H_
+#define __ENTRY_H_
+
+enum
+{
+	SYSCALL_CFORK,
+	SYSCALL_CLONE,
+	SYSCALL_CLOSE,
+	SYSCALL_CONFIGURE,
+	SYSCALL_DUMP_PTT,
+	SYSCALL_DUP2,
+	SYSCALL_DUP,
+	SYSCALL_END_STRACE,
+	SYSCALL_EXIT,
+	SYSCALL_EXPAND,
+	SYSCALL_FORK,
+	SYSCALL_FTRACE,
+	SYSCALL_GET_COW_F,
+	SYSCALL_GET_USER_P,
+	SYSCALL_GETPID,
+	SYSCALL_LSEEK,
+	SYSCALL_MMAP,
+	SYSCALL_MPROTECT,
+	SYSCALL_MUNMAP,
+	SYSCALL_OPEN,
+	SYSCALL_PHYS_INFO,
+	SYSCALL_PMAP,
+	SYSCALL_READ,
+	SYSCALL_READ_FTRACE,
+	SYSCALL_READ_STRACE,
+	SYSCALL_SIGNAL,
+	SYSCALL_SLEEP,
+	SYSCALL_START_STRACE,
+	SYSCALL_STATS,
+	SYSCALL_STRACE,
+	SYSCALL_TRACE_BUFFER,
+	SYSCALL_VFORK,
+	SYSCALL_WRITE
+};
+
+#endif
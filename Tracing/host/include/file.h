@@ -0,0 +1,32 @@
+#ifndef __FILE_H_
+#define __FILE_H_
+
+#include <types.h>
+
+#define TRACE_BUFFER 3
+#define O_READ 0x1
+#define O_WRITE 0x2
+#define O_RDWR (O_READ | O_WRITE)
+
+struct file;
+struct trace_buffer_info;
+
+struct fileops
+{
+	int (*read)(struct file *filep, char *buff, u32 count);
+	int (*write)(struct file *filep, char *buff, u32 count);
+	long (*lseek)(struct file *filep, long offset, int whence);
+	long (*close)(struct file *filep);
+};
+
+struct file
+{
+	u32 type;
+	u32 mode;
+	u32 offp;
+	u32 ref_count;
+	struct trace_buffer_info *trace_buffer;
+	struct fileops *fops;
+};
+
+#endif
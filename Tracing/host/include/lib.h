@@ -0,0 +1,8 @@
+#ifndef __LIB_H_
+#define __LIB_H_
+
+#define EINVAL 22
+#define ENOMEM 12
+#define EBADMEM 99
+
+#endif
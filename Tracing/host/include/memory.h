@@ -0,0 +1,17 @@
+#ifndef __MEMORY_H_
+#define __MEMORY_H_
+
+#include <types.h>
+
+#define USER_REG 1
+#define OS_PT_REG 2
+
+extern void *os_alloc(u32 size);
+extern void os_free(void *ptr, u32 size);
+extern void *os_page_alloc(u32 region);
+extern void os_page_free(u32 region, void *ptr);
+extern u64 os_pfn_alloc(u32 region);
+extern void os_pfn_free(u32 region, u64 pfn);
+extern void *osmap(u64 pfn);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __MMAP_H_
+#define __MMAP_H_
+
+#include <types.h>
+
+#define MMAP_AREA_START 0x180000000UL
+#define MMAP_AREA_END 0x200000000UL
+#define PROT_READ 0x1
+#define PROT_WRITE 0x2
+
+struct vm_stats
+{
+	u64 num_vm_area;
+};
+
+extern struct vm_stats *stats;
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __PAGE_H_
+#define __PAGE_H_
+
+#include <types.h>
+
+extern void get_pfn(u64 pfn);
+extern void put_pfn(u64 pfn);
+extern int get_pfn_refcount(u64 pfn);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __TYPES_H_
+#define __TYPES_H_
+
+// Host stand-ins for the gemOS headers tracer.c includes, just enough to
+// build it as an ordinary user program for the tests in Tracing/host.
+
+#include <stddef.h>
+
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned int u32;
+typedef unsigned long u64;
+
+#endif
@@ -0,0 +1,145 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <context.h>
+#include <memory.h>
+#include <mmap.h>
+#include <page.h>
+#include <sched.h>
+#include <tracer.h>
+
+// Just enough of the gemOS kernel for tracer.c to run as a host program.
+// Pages come from aligned_alloc, so osmap() is the identity on pfn << 12
+// as in the kernel's identity-mapped region. USER_REG pages start with a
+// reference count of 1 (as a faulted-in user page does). live_pages and
+// live_bytes count what is handed out and not yet returned, so tests can
+// spot leaks and early frees; once alloc_budget allocations have been
+// made (if it is not negative) every further one fails. Built with
+// -DTRACE_NR_CPUS=n, the host CPU folded onto n ids is the writer's CPU.
+
+#define PAGE_SIZE 4096
+#define PFN_SLOTS (1 << 16)
+
+long live_pages;
+long live_bytes;
+long alloc_budget = -1;
+
+static struct vm_stats vm_stats;
+struct vm_stats *stats = &vm_stats;
+
+static struct exec_context ctx;
+
+// pfn -> reference count, open addressing; slots are never emptied
+static struct { u64 pfn; int count; } refs[PFN_SLOTS];
+
+static int *ref_slot(u64 pfn)
+{
+	u32 i = (pfn * 0x9E3779B97F4A7C15UL) >> 48;
+
+	for (u32 n = 0; n < PFN_SLOTS; n++, i = (i + 1) & (PFN_SLOTS - 1))
+	{
+		if (refs[i].pfn == pfn)
+			return &refs[i].count;
+		if (refs[i].pfn == 0)
+		{
+			refs[i].pfn = pfn;
+			return &refs[i].count;
+		}
+	}
+	fprintf(stderr, "kstub: pfn table full\n");
+	exit(1);
+}
+
+struct exec_context *get_current_ctx(void)
+{
+	// any buffer passes is_valid_mem_range through the last segment
+	if (ctx.mms[3].end == 0)
+	{
+		ctx.pid = 1;
+		ctx.mms[3].end = ~0UL;
+		ctx.mms[3].access_flags = 7;
+	}
+	return &ctx;
+}
+
+static int alloc_fails(void)
+{
+	if (alloc_budget < 0)
+		return 0;
+	if (alloc_budget == 0)
+		return 1;
+	alloc_budget--;
+	return 0;
+}
+
+void *os_alloc(u32 size)
+{
+	if (alloc_fails())
+		return NULL;
+	live_bytes += size;
+	return malloc(size);
+}
+
+void os_free(void *ptr, u32 size)
+{
+	live_bytes -= size;
+	free(ptr);
+}
+
+void *os_page_alloc(u32 region)
+{
+	if (alloc_fails())
+		return NULL;
+	void *page = aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+	if (!page)
+		return NULL;
+	memset(page, 0, PAGE_SIZE);
+	*ref_slot((u64)page >> 12) = region == USER_REG;
+	live_pages++;
+	return page;
+}
+
+void os_page_free(u32 region, void *ptr)
+{
+	(void)region;
+	live_pages--;
+	free(ptr);
+}
+
+u64 os_pfn_alloc(u32 region)
+{
+	return (u64)os_page_alloc(region) >> 12;
+}
+
+void os_pfn_free(u32 region, u64 pfn)
+{
+	os_page_free(region, osmap(pfn));
+}
+
+void *osmap(u64 pfn)
+{
+	return (void *)(pfn << 12);
+}
+
+void get_pfn(u64 pfn)
+{
+	(*ref_slot(pfn))++;
+}
+
+void put_pfn(u64 pfn)
+{
+	(*ref_slot(pfn))--;
+}
+
+int get_pfn_refcount(u64 pfn)
+{
+	return *ref_slot(pfn);
+}
+
+#if TRACE_NR_CPUS > 1
+u32 trace_this_cpu(void)
+{
+	return sched_getcpu() % TRACE_NR_CPUS;
+}
+#endif
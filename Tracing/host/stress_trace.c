@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include <context.h>
+#include <file.h>
+#include <tracer.h>
+
+// Producer/consumer stress for the lock-free trace rings. A producer thread
+// writes a byte stream in which the byte at offset k is a hash of k, in
+// random-length writes, while a consumer thread reads it back in random-
+// length reads and checks every byte against its offset. A lost, repeated,
+// torn or stale byte shows up at the first offset it touches. Each ring
+// size is run in turn; small rings keep both sides at the full and empty
+// boundaries.
+//
+// A second phase runs several producers into one buffer through
+// TraceBufferWriter(), as strace and ftrace do from different CPUs. Each
+// record carries its producer, a sequence number and a payload derived
+// from both; the consumer parses the merged stream and checks that every
+// record arrives once and intact. Threads on one CPU share its ring and
+// its producer lock; built with -DTRACE_NR_CPUS=4 the buffer has a ring
+// per host CPU (folded onto four), and the reader merges them.
+//
+// gcc -O2 -I host/include -I . host/stress_trace.c host/kstub.c tracer.c -o stress_trace -pthread
+// ./stress_trace [MB per size]
+
+#define PRODUCERS 4
+
+// the in-kernel producer path, not declared in tracer.h
+extern int TraceBufferWriter(struct file *filep, char *buff, u32 count);
+
+struct stream
+{
+	struct file *filep;
+	u32 size;
+	u64 total;
+};
+
+struct message
+{
+	u32 id;
+	u32 len;
+	u64 seq;
+};
+
+struct producer_arg
+{
+	struct stream *st;
+	u32 id;
+};
+
+static inline u8 stream_byte(u64 k)
+{
+	return (k * 0x9E3779B97F4A7C15UL) >> 56;
+}
+
+static u64 rng(u64 *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+static void *producer(void *arg)
+{
+	struct stream *st = arg;
+	u64 state = 88172645463325252UL, off = 0;
+	char buff[8192];
+
+	// writes larger than a small ring come back short
+	while (off < st->total)
+	{
+		u32 count = 1 + rng(&state) % sizeof(buff);
+		if (count > st->total - off)
+			count = st->total - off;
+		for (u32 i = 0; i < count; i++)
+			buff[i] = stream_byte(off + i);
+
+		int n = st->filep->fops->write(st->filep, buff, count);
+		if (n < 0)
+		{
+			fprintf(stderr, "write failed at offset %lu\n", off);
+			exit(1);
+		}
+		if (n == 0)
+			sched_yield();
+		off += n;
+	}
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	struct stream *st = arg;
+	u64 state = 0x2545F4914F6CDD1DUL, off = 0;
+	char buff[8192];
+
+	while (off < st->total)
+	{
+		u32 count = 1 + rng(&state) % sizeof(buff);
+		int n = st->filep->fops->read(st->filep, buff, count);
+		if (n < 0)
+		{
+			fprintf(stderr, "read failed at offset %lu\n", off);
+			exit(1);
+		}
+		if (n == 0)
+			sched_yield();
+		for (int i = 0; i < n; i++)
+			if ((u8)buff[i] != stream_byte(off + i))
+			{
+				fprintf(stderr, "size %u: bad byte at offset %lu\n", st->size, off + i);
+				exit(1);
+			}
+		off += n;
+	}
+	return NULL;
+}
+
+static inline u8 message_byte(struct message *m, u32 i)
+{
+	return stream_byte(m->seq * PRODUCERS + m->id + i);
+}
+
+// records per producer in the multi-producer phase
+static u64 message_count(struct stream *st)
+{
+	return st->total / PRODUCERS / 256 + 1;
+}
+
+static void *message_producer(void *arg)
+{
+	struct producer_arg *pa = arg;
+	struct stream *st = pa->st;
+	u64 state = 88172645463325252UL + pa->id;
+	char buff[512];
+	struct message *m = (struct message *)buff;
+	u32 max = st->size - sizeof(struct trace_record);
+	if (max > sizeof(buff))
+		max = sizeof(buff);
+
+	for (u64 seq = 0; seq < message_count(st); seq++)
+	{
+		m->id = pa->id;
+		m->seq = seq;
+		m->len = rng(&state) % (max - sizeof(*m) + 1);
+		for (u32 i = 0; i < m->len; i++)
+			buff[sizeof(*m) + i] = message_byte(m, i);
+
+		int n;
+		while ((n = TraceBufferWriter(st->filep, buff, sizeof(*m) + m->len)) == 0)
+			sched_yield();
+		if (n != (int)(sizeof(*m) + m->len))
+		{
+			fprintf(stderr, "producer %u: write failed\n", pa->id);
+			exit(1);
+		}
+	}
+	return NULL;
+}
+
+static void read_full(struct file *filep, char *buff, u32 count)
+{
+	while (count > 0)
+	{
+		int n = filep->fops->read(filep, buff, count);
+		if (n < 0)
+		{
+			fprintf(stderr, "read failed\n");
+			exit(1);
+		}
+		if (n == 0)
+			sched_yield();
+		buff += n;
+		count -= n;
+	}
+}
+
+static void *message_consumer(void *arg)
+{
+	struct stream *st = arg;
+	u64 count = message_count(st);
+	u64 left = count * PRODUCERS;
+	char *seen = calloc(count * PRODUCERS, 1);
+	char payload[512];
+	struct message m;
+	if (!seen)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+
+	while (left > 0)
+	{
+		read_full(st->filep, (char *)&m, sizeof(m));
+		if (m.id >= PRODUCERS || m.seq >= count || m.len > sizeof(payload) || seen[m.seq * PRODUCERS + m.id])
+		{
+			fprintf(stderr, "size %u: bad record header (producer %u, seq %lu)\n", st->size, m.id, m.seq);
+			exit(1);
+		}
+		read_full(st->filep, payload, m.len);
+		for (u32 i = 0; i < m.len; i++)
+			if ((u8)payload[i] != message_byte(&m, i))
+			{
+				fprintf(stderr, "size %u: torn record (producer %u, seq %lu)\n", st->size, m.id, m.seq);
+				exit(1);
+			}
+		seen[m.seq * PRODUCERS + m.id] = 1;
+		left--;
+	}
+	free(seen);
+	return NULL;
+}
+
+// runs one phase on a fresh buffer of the given size
+static void run(u32 size, long mb, int producers)
+{
+	struct exec_context *current = get_current_ctx();
+	int fd = sys_create_sized_trace_buffer(current, O_RDWR, size);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Unable to create the trace buffer\n");
+		exit(1);
+	}
+
+	struct stream st = { current->files[fd], size, (u64)mb << 20 };
+	struct producer_arg args[PRODUCERS];
+	pthread_t prod[PRODUCERS], cons;
+	int err = pthread_create(&cons, NULL, producers > 1 ? message_consumer : consumer, &st);
+	for (int p = 0; p < producers; p++)
+	{
+		args[p].st = &st;
+		args[p].id = p;
+		err |= pthread_create(&prod[p], NULL, producers > 1 ? message_producer : producer, producers > 1 ? (void *)&args[p] : (void *)&st);
+	}
+	if (err)
+	{
+		perror("Unable to execute\n");
+		exit(1);
+	}
+	for (int p = 0; p < producers; p++)
+		pthread_join(prod[p], NULL);
+	pthread_join(cons, NULL);
+
+	st.filep->fops->close(st.filep);
+	current->files[fd] = NULL;
+	printf("%8u bytes, %d producer%s: %ld MB ok\n", size, producers, producers > 1 ? "s" : "", mb);
+}
+
+int main(int argc, char *argv[])
+{
+	long mb = argc > 1 ? atol(argv[1]) : 64;
+	if (mb <= 0)
+	{
+		fprintf(stderr, "usage: %s [MB per size]\n", argv[0]);
+		exit(1);
+	}
+
+	u32 sizes[] = { TRACE_BUFFER_MIN_SIZE, 256, TRACE_BUFFER_PAGE_SIZE, 16 * TRACE_BUFFER_PAGE_SIZE, TRACE_BUFFER_MAX_SIZE };
+
+	for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+	{
+		run(sizes[s], mb, 1);
+		run(sizes[s], mb, PRODUCERS);
+	}
+	return 0;
+}
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <context.h>
+#include <lib.h>
+#include <memory.h>
+#include <page.h>
+#include <file.h>
+#include <tracer.h>
+
+// Checks trace buffer read()/write() against a byte-by-byte model: every
+// byte a write accepts is appended to a plain FIFO, and every byte a read
+// returns must be the next one out of it. Transfer sizes are random, from
+// one byte to past the ring size, over every power-of-two ring size, so
+// copies start and end at every offset, wrap, and cross page boundaries.
+// A write larger than a ring must still be taken in part, and record
+// headers must not eat into the capacity: a ring takes size bytes however
+// the stream is split into writes.
+// The buffer must give back every page it took once it is closed, and a
+// create that runs out of memory part-way must give back everything it
+// took before failing. Pages still referenced from elsewhere when the
+// buffer is closed (by a forked reader's copy of the mapping) must stay
+// allocated until that reference is put.
+//
+// gcc -O2 -I host/include -I . host/test_trace.c host/kstub.c tracer.c -o test_trace
+// ./test_trace [ops]
+
+extern long live_pages;
+extern long live_bytes;
+extern long alloc_budget;
+
+static unsigned long rng_state = 88172645463325252UL;
+
+static unsigned long rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static void fail(const char *what, u32 size, long op)
+{
+	fprintf(stderr, "size %u, op %ld: %s\n", size, op, what);
+	exit(1);
+}
+
+static void run(u32 size, long ops)
+{
+	struct exec_context *current = get_current_ctx();
+	long pages = live_pages, bytes = live_bytes;
+
+	int fd = sys_create_sized_trace_buffer(current, O_RDWR, size);
+	if (fd < 0)
+		fail("create failed", size, -1);
+	struct file *filep = current->files[fd];
+
+	// the model never holds more than one ring's worth per CPU
+	u32 cap = 2 * size + 64;
+	char *in = malloc(cap), *out = malloc(cap);
+	char *model = malloc(TRACE_NR_CPUS * size);
+	u32 model_len = 0;
+	unsigned char next = 0;
+	if (!in || !out || !model)
+		fail("out of memory", size, -1);
+
+	for (long op = 0; op < ops; op++)
+	{
+		u32 count = 1 + rng() % (rng() % 4 ? 64 : cap - 1);
+
+		if (rng() % 2)
+		{
+			for (u32 i = 0; i < count; i++)
+				in[i] = next + i;
+			int n = filep->fops->write(filep, in, count);
+			if (n < 0 || (u32)n > count)
+				fail("bad write return", size, op);
+			// the writer's ring holds at most what the model does
+			u32 room = model_len < size ? size - model_len : 0;
+			if ((u32)n < (count < room ? count : room))
+				fail("write took less than the free space", size, op);
+			if (model_len + n > TRACE_NR_CPUS * size)
+				fail("write accepted more than the rings hold", size, op);
+			memcpy(model + model_len, in, n);
+			model_len += n;
+			next += n;
+			continue;
+		}
+
+		int n = filep->fops->read(filep, out, count);
+		if (n < 0 || (u32)n > count)
+			fail("bad read return", size, op);
+		if ((u32)n != (count < model_len ? count : model_len))
+			fail("read returned fewer bytes than were buffered", size, op);
+		if (memcmp(out, model, n))
+			fail("read returned the wrong bytes", size, op);
+		memmove(model, model + n, model_len - n);
+		model_len -= n;
+	}
+
+	filep->fops->close(filep);
+	current->files[fd] = NULL;
+	if (live_pages != pages || live_bytes != bytes)
+		fail("memory leaked by close", size, ops);
+
+	free(in);
+	free(out);
+	free(model);
+}
+
+// a fresh buffer filled by equal writes until one is refused takes size
+// bytes, however small the writes
+static void fill(u32 size, u32 count)
+{
+	struct exec_context *current = get_current_ctx();
+	int fd = sys_create_sized_trace_buffer(current, O_RDWR, size);
+	if (fd < 0)
+		fail("create failed", size, -1);
+	struct file *filep = current->files[fd];
+
+	char in[8] = { 0 };
+	u32 total = 0;
+	int n;
+	while ((n = filep->fops->write(filep, in, count)) > 0)
+		total += n;
+	if (total < size || total > TRACE_NR_CPUS * size)
+		fail("rings filled to the wrong level", size, count);
+
+	filep->fops->close(filep);
+	current->files[fd] = NULL;
+}
+
+// fails the first, second, ... allocation of a create until one succeeds
+static void failed_create(u32 size)
+{
+	struct exec_context *current = get_current_ctx();
+	long pages = live_pages, bytes = live_bytes;
+
+	for (long budget = 0; ; budget++)
+	{
+		alloc_budget = budget;
+		int fd = sys_create_sized_trace_buffer(current, O_RDWR, size);
+		alloc_budget = -1;
+
+		if (fd >= 0)
+		{
+			current->files[fd]->fops->close(current->files[fd]);
+			current->files[fd] = NULL;
+			break;
+		}
+		if (fd != -ENOMEM)
+			fail("create failed with the wrong error", size, budget);
+		if (live_pages != pages || live_bytes != bytes)
+			fail("memory leaked by a failed create", size, budget);
+	}
+}
+
+// takes a reference to every page, as copying a reader's mapping into a
+// forked child does, and drops it after close the way unmapping does
+static void shared_pages(u32 size)
+{
+	struct exec_context *current = get_current_ctx();
+	long pages = live_pages, bytes = live_bytes;
+
+	int fd = sys_create_sized_trace_buffer(current, O_RDWR, size);
+	if (fd < 0)
+		fail("create failed", size, -1);
+	struct file *filep = current->files[fd];
+	struct trace_buffer_info *tb = filep->trace_buffer;
+
+	u32 n = 1 + tb->num_cpus * tb->num_pages;
+	u64 *pfns = malloc(n * sizeof(u64));
+	if (!pfns)
+		fail("out of memory", size, -1);
+	pfns[0] = (u64)tb->header >> TRACE_BUFFER_PAGE_SHIFT;
+	for (u32 i = 1; i < n; i++)
+		pfns[i] = (u64)tb->rings[(i - 1) / tb->num_pages].pages[(i - 1) % tb->num_pages] >> TRACE_BUFFER_PAGE_SHIFT;
+	for (u32 i = 0; i < n; i++)
+		get_pfn(pfns[i]);
+
+	filep->fops->close(filep);
+	current->files[fd] = NULL;
+	if (live_pages != pages + n)
+		fail("close freed pages that were still referenced", size, -1);
+
+	for (u32 i = 0; i < n; i++)
+	{
+		put_pfn(pfns[i]);
+		if (get_pfn_refcount(pfns[i]) == 0)
+			os_pfn_free(USER_REG, pfns[i]);
+	}
+	if (live_pages != pages || live_bytes != bytes)
+		fail("memory leaked once the last reference went", size, -1);
+	free(pfns);
+}
+
+// the syscall's mode-only form: default size, or the size carried in mode
+static void mode_sizes(void)
+{
+	struct exec_context *current = get_current_ctx();
+	int modes[] = { O_RDWR, O_READ | TRACE_BUFFER_SIZE_SHIFT(16), O_RDWR | TRACE_BUFFER_SIZE_SHIFT(5), O_RDWR | TRACE_BUFFER_SIZE_SHIFT(40) };
+	u32 sizes[] = { TRACE_BUFFER_DEFAULT_SIZE, 1 << 16, 0, 0 };
+
+	for (int i = 0; i < 4; i++)
+	{
+		int fd = sys_create_trace_buffer(current, modes[i]);
+		if (sizes[i] == 0)
+		{
+			if (fd != -EINVAL)
+				fail("bad size in mode accepted", modes[i], -1);
+			continue;
+		}
+		if (fd < 0)
+			fail("create failed", modes[i], -1);
+
+		struct file *filep = current->files[fd];
+		if (filep->trace_buffer->size != sizes[i] || filep->mode != (u32)(modes[i] & TRACE_BUFFER_MODE_MASK))
+			fail("mode-only create made the wrong buffer", modes[i], -1);
+		filep->fops->close(filep);
+		current->files[fd] = NULL;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	long ops = argc > 1 ? atol(argv[1]) : 20000;
+
+	mode_sizes();
+	failed_create(TRACE_BUFFER_MIN_SIZE);
+	failed_create(4 * TRACE_BUFFER_PAGE_SIZE);
+	shared_pages(TRACE_BUFFER_MIN_SIZE);
+	shared_pages(4 * TRACE_BUFFER_PAGE_SIZE);
+
+	for (u32 size = TRACE_BUFFER_MIN_SIZE; size <= TRACE_BUFFER_MAX_SIZE; size *= 2)
+	{
+		fill(size, 1);
+		fill(size, 8);
+		run(size, ops);
+	}
+
+	printf("ok\n");
+	return 0;
+}
@@ -3,6 +3,8 @@
 #include <lib.h>
 #include <entry.h>
 #include <file.h>
+#include <mmap.h>
+#include <page.h>
 #include <tracer.h>
 ///////////////////////////////////////////////////////////////////////////
 //// 		Start of Trace buffer functionality 		      /////
@@ -70,100 +72,302 @@ int is_valid_mem_range(unsigned long buff, u32 count, int access_bit)
 	return -1;
 }
 
+// Drops the buffer's own reference to a page. A mapping that outlives the
+// buffer (a forked copy of the reader, or the reader's own when another
+// process closes the buffer) holds one of its own, and the page goes back
+// to the allocator when the last of them is put.
+static void trace_put_page(char *page)
+{
+	u64 pfn = (u64)page >> TRACE_BUFFER_PAGE_SHIFT;
+	put_pfn(pfn);
+	if (get_pfn_refcount(pfn) == 0)
+		os_page_free(USER_REG, page);
+}
+
+static void free_trace_pages(struct trace_buffer_info *tb)
+{
+	for (u32 cpu = 0; cpu < tb->num_cpus; cpu++)
+	{
+		char **pages = tb->rings[cpu].pages;
+		if (!pages)
+			continue;
+		for (u32 i = 0; i < tb->num_pages; i++)
+			if (pages[i])
+				trace_put_page(pages[i]);
+		os_free(pages, tb->num_pages * sizeof(char *));
+	}
+	if (tb->header)
+		trace_put_page((char *)tb->header);
+}
+
+static void trace_unmap(struct exec_context *current, struct trace_buffer_info *tb);
+
 long trace_buffer_close(struct file *filep)
 {
 	if(!filep) return -EINVAL;
 	if(!(filep->trace_buffer)) return -EINVAL;
-	if(!(filep->trace_buffer->buffer)) return -EINVAL;
 	if(!(filep->fops)) return -EINVAL;
 
 
+	// only the mapping process's page table holds the mapping; any other
+	// copy keeps its pages referenced until that process unmaps them
+	struct exec_context *current = get_current_ctx();
+	if (filep->trace_buffer->map_start && current->pid == filep->trace_buffer->map_pid)
+		trace_unmap(current, filep->trace_buffer);
+
 	os_free(filep->fops, sizeof(struct fileops));
-	os_page_free(USER_REG, filep->trace_buffer->buffer);
+	free_trace_pages(filep->trace_buffer);
 	os_free(filep->trace_buffer, sizeof(struct trace_buffer_info));
 	os_page_free(USER_REG, filep);
 	return 0;
 }
 
-int trace_buffer_read(struct file *filep, char *buff, u32 count)
+// rdtsc is architectural on every x86-64 CPU, unlike rdtscp. Stamps only
+// order records across rings; within a ring the ring order is kept (see
+// trace_append), and CPUs are assumed to share a synchronised TSC.
+static inline u64 trace_clock(void)
 {
-	if (is_valid_mem_range((unsigned long)buff, count, 2) != 0)
-		return -EBADMEM;
+	u32 lo, hi;
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((u64)hi << 32) | lo;
+}
 
-	u32 tb_writer = filep->trace_buffer->writer;
-	u32 tb_reader = filep->trace_buffer->reader;
-	char *tb_buff = filep->trace_buffer->buffer;
-	u32 max_bytes = count;
-
-	int diff = tb_writer - tb_reader;
-	if ((diff == 0 && filep->trace_buffer->isFull == 1) || diff < 0)
-		diff += TRACE_BUFFER_MAX_SIZE;
-	if (max_bytes > diff)
-		max_bytes = diff;
-	if (filep->trace_buffer->isFull == 0 && diff == 0)
-		max_bytes = 0;
-	if (max_bytes == 0)
-		return 0;
+static inline u32 trace_cpu(void)
+{
+#if TRACE_NR_CPUS > 1
+	return trace_this_cpu();
+#else
+	return 0;
+#endif
+}
+
+static inline void trace_lock(struct trace_index *idx)
+{
+	while (__atomic_exchange_n(&idx->lock, 1, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&idx->lock, __ATOMIC_RELAXED))
+			asm volatile("pause");
+}
+
+static inline void trace_unlock(struct trace_index *idx)
+{
+	__atomic_store_n(&idx->lock, 0, __ATOMIC_RELEASE);
+}
+
+// Copies eight bytes at a time, then the tail.
+static void trace_copy(char *dst, char *src, u32 count)
+{
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8)
+		*(u64 *)(dst + i) = *(u64 *)(src + i);
+	for (; i < count; i++)
+		dst[i] = src[i];
+}
+
+// Moves count bytes between buff and ring starting at counter value pos,
+// one contiguous block per page (or per wrap, for rings smaller than a
+// page).
+static void trace_ring_copy(struct trace_buffer_info *tb, struct trace_ring *ring, u64 pos, char *buff, u32 count, int to_ring)
+{
+	u32 off = pos % tb->ring_size;
 
-	for (int i = 0; i < max_bytes; i++)
+	while (count > 0)
 	{
-		buff[i] = tb_buff[tb_reader];
-		tb_reader++;
-		tb_reader %= TRACE_BUFFER_MAX_SIZE;
-	}
-	filep->trace_buffer->reader = tb_reader;
-	filep->offp = tb_reader;
-	filep->trace_buffer->isFull = 0;
+		u32 page_off = off & (TRACE_BUFFER_PAGE_SIZE - 1);
+		u32 chunk = TRACE_BUFFER_PAGE_SIZE - page_off;
+		if (chunk > tb->ring_size - off)
+			chunk = tb->ring_size - off;
+		if (chunk > count)
+			chunk = count;
+
+		char *page = ring->pages[off >> TRACE_BUFFER_PAGE_SHIFT] + page_off;
+		if (to_ring)
+			trace_copy(page, buff, chunk);
+		else
+			trace_copy(buff, page, chunk);
 
-	return max_bytes;
+		buff += chunk;
+		count -= chunk;
+		off += chunk;
+		if (off == tb->ring_size)
+			off = 0;
+	}
 }
 
-int trace_buffer_write(struct file *filep, char *buff, u32 count)
+// Ring copies used by both the read()/write() file operations and the
+// in-kernel strace/ftrace producers and consumers. The acquire load of the
+// other side's counter orders the copy after it; the release store of our
+// own counter publishes the copied bytes (or the freed space) with it.
+//
+// The reader hands out payload bytes only, merging the rings by picking
+// the oldest head record each time a new record is started. It claims the
+// record under the ring's lock and only then reads its length, which a
+// user write may have grown since the record was picked; the timestamp
+// never changes.
+int TraceBufferReader(struct file *filep, char *buff, u32 count)
 {
-	if (is_valid_mem_range((unsigned long)buff, count, 1) != 0)
-		return -EBADMEM;
+	struct trace_buffer_info *tb = filep->trace_buffer;
+	u32 copied = 0;
 
-	if (filep == NULL)
+	while (copied < count)
 	{
-		return -EINVAL;
+		if (tb->cur_cpu < 0)
+		{
+			struct trace_record rec, oldest = {0, 0, 0};
+
+			for (int cpu = 0; cpu < (int)tb->num_cpus; cpu++)
+			{
+				struct trace_ring *ring = &tb->rings[cpu];
+				u64 tail = ring->idx->tail;
+				if (__atomic_load_n(&ring->idx->head, __ATOMIC_ACQUIRE) == tail)
+					continue;
+
+				trace_ring_copy(tb, ring, tail, (char *)&rec, sizeof(rec), 0);
+				if (tb->cur_cpu < 0 || rec.tsc < oldest.tsc)
+				{
+					oldest = rec;
+					tb->cur_cpu = cpu;
+				}
+			}
+			if (tb->cur_cpu < 0)
+				break;
+
+			struct trace_ring *ring = &tb->rings[tb->cur_cpu];
+			trace_lock(ring->idx);
+			trace_ring_copy(tb, ring, ring->idx->tail, (char *)&oldest, sizeof(oldest), 0);
+			__atomic_store_n(&ring->idx->tail, ring->idx->tail + sizeof(oldest), __ATOMIC_RELEASE);
+			trace_unlock(ring->idx);
+			tb->cur_left = oldest.len;
+		}
+
+		struct trace_ring *ring = &tb->rings[tb->cur_cpu];
+		u32 n = tb->cur_left;
+		if (n > count - copied)
+			n = count - copied;
+
+		trace_ring_copy(tb, ring, ring->idx->tail, buff + copied, n, 0);
+		__atomic_store_n(&ring->idx->tail, ring->idx->tail + n, __ATOMIC_RELEASE);
+
+		copied += n;
+		tb->cur_left -= n;
+		if (tb->cur_left == 0)
+			tb->cur_cpu = -1;
 	}
 
-	u32 tb_writer = filep->trace_buffer->writer;
-	u32 tb_reader = filep->trace_buffer->reader;
-	char *tb_buff = filep->trace_buffer->buffer;
-	u32 max_bytes = count;
+	return copied;
+}
+
+// Appends buff to the current CPU's ring and returns the payload bytes
+// taken. If the free space is short, a partial append takes as much as
+// fits; otherwise the record is dropped whole, so an in-kernel record is
+// never torn. Either way 0 means the ring is full.
+//
+// A partial (user) append grows the ring's newest user record instead of
+// starting one, as long as the reader has not claimed that record's header
+// and no reader has the buffer mapped, so a byte stream pays for one
+// header however it is split into writes. With the ring's header of slack
+// (see sys_create_sized_trace_buffer) it then holds size bytes. The grown
+// record keeps its first timestamp, so across rings its later bytes are
+// ordered by that first write.
+static int trace_append(struct trace_buffer_info *tb, char *buff, u32 count, int partial)
+{
+	struct trace_record rec;
+
+	rec.tsc = trace_clock();
+	rec.cpu = trace_cpu();
 
-	int diff = tb_reader - tb_writer;
-	if ((diff == 0 && filep->trace_buffer->isFull == 0) || diff < 0)
-		diff += TRACE_BUFFER_MAX_SIZE;
-	if (max_bytes > diff)
-		max_bytes = diff;
-	if (filep->trace_buffer->isFull == 1)
-		max_bytes = 0; // sanity check
+	struct trace_ring *ring = &tb->rings[rec.cpu];
+	struct trace_index *idx = ring->idx;
 
-	if (max_bytes == 0)
+	trace_lock(idx);
+	u64 head = idx->head;
+	u64 tail = __atomic_load_n(&idx->tail, __ATOMIC_ACQUIRE);
+
+	u32 room = tb->ring_size - (head - tail);
+	int extend = partial && !tb->map_start && idx->last != TRACE_NO_RECORD && tail <= idx->last;
+	if (!extend)
+		room = room > sizeof(rec) ? room - sizeof(rec) : 0;
+	if (partial && count > room)
+		count = room;
+	if (count == 0 || count > room)
+	{
+		trace_unlock(idx);
 		return 0;
+	}
+
+	if (extend)
+	{
+		idx->last_len += count;
+		trace_ring_copy(tb, ring, idx->last + sizeof(rec.tsc), (char *)&idx->last_len, sizeof(idx->last_len), 1);
+		trace_ring_copy(tb, ring, head, buff, count, 1);
+		__atomic_store_n(&idx->head, head + count, __ATOMIC_RELEASE);
+		trace_unlock(idx);
+		return count;
+	}
+	rec.len = count;
+
+	// a writer that shared the ring may have stamped later but locked first
+	if (rec.tsc < idx->stamp)
+		rec.tsc = idx->stamp;
+	idx->stamp = rec.tsc;
+	trace_ring_copy(tb, ring, head, (char *)&rec, sizeof(rec), 1);
+	trace_ring_copy(tb, ring, head + sizeof(rec), buff, count, 1);
+	__atomic_store_n(&idx->head, head + sizeof(rec) + count, __ATOMIC_RELEASE);
+	idx->last = partial ? head : TRACE_NO_RECORD;
+	idx->last_len = count;
+	trace_unlock(idx);
+
+	return count;
+}
 
-	for (int i = 0; i < max_bytes; i++)
+// In-kernel producers (strace, ftrace) write whole records or nothing.
+int TraceBufferWriter(struct file *filep, char *buff, u32 count)
+{
+	if (filep == NULL)
 	{
-		tb_buff[tb_writer] = buff[i];
-		tb_writer++;
-		tb_writer %= TRACE_BUFFER_MAX_SIZE;
+		return -EINVAL;
 	}
 
-	filep->trace_buffer->writer = tb_writer;
-	filep->offp = tb_writer;
-	if (tb_reader == tb_writer)
-		filep->trace_buffer->isFull = 1;
+	return trace_append(filep->trace_buffer, buff, count, 0);
+}
+
+int trace_buffer_read(struct file *filep, char *buff, u32 count)
+{
+	if (is_valid_mem_range((unsigned long)buff, count, 2) != 0)
+		return -EBADMEM;
+
+	return TraceBufferReader(filep, buff, count);
+}
+
+int trace_buffer_write(struct file *filep, char *buff, u32 count)
+{
+	if (is_valid_mem_range((unsigned long)buff, count, 1) != 0)
+		return -EBADMEM;
 
-	return max_bytes;
+	// a short write, like the original byte ring, so a write larger than
+	// a ring still makes progress
+	return trace_append(filep->trace_buffer, buff, count, 1);
 }
 
+// The syscall entry point; mode may carry a size (see tracer.h).
 int sys_create_trace_buffer(struct exec_context *current, int mode)
+{
+	u32 shift = (u32)mode >> TRACE_BUFFER_SHIFT_BITS;
+	if (shift >= 32)
+		return -EINVAL;
+
+	return sys_create_sized_trace_buffer(current, mode & TRACE_BUFFER_MODE_MASK, shift ? 1U << shift : 0);
+}
+
+int sys_create_sized_trace_buffer(struct exec_context *current, int mode, u32 size)
 {
 	if (!current)
 		return -EINVAL;
 
+	if (size == 0)
+		size = TRACE_BUFFER_DEFAULT_SIZE;
+	if (size < TRACE_BUFFER_MIN_SIZE || size > TRACE_BUFFER_MAX_SIZE || (size & (size - 1)))
+		return -EINVAL;
+
 	int fd = 0;
 	for (fd = 0; fd < MAX_OPEN_FILES; fd++)
 		if ((current->files)[fd] == NULL)
@@ -176,21 +380,86 @@ int sys_create_trace_buffer(struct exec_context *current, int mode)
 	if (!TraceBuffer)
 		return -ENOMEM;
 
-	TraceBuffer->buffer = (char *)os_page_alloc(USER_REG);
-	if (!(TraceBuffer->buffer))
+	// one record header of slack: a user byte stream leaves at most one
+	// unclaimed header in a ring, so its payload can fill size bytes
+	TraceBuffer->size = size;
+	TraceBuffer->ring_size = size + sizeof(struct trace_record);
+	TraceBuffer->num_pages = (TraceBuffer->ring_size + TRACE_BUFFER_PAGE_SIZE - 1) >> TRACE_BUFFER_PAGE_SHIFT;
+	TraceBuffer->num_cpus = TRACE_NR_CPUS;
+	TraceBuffer->cur_cpu = -1;
+	TraceBuffer->cur_left = 0;
+	TraceBuffer->map_start = 0;
+	TraceBuffer->map_pid = 0;
+
+	for (int cpu = 0; cpu < TRACE_MAX_CPUS; cpu++)
+		TraceBuffer->rings[cpu].pages = NULL;
+
+	struct trace_header *header = (struct trace_header *)os_page_alloc(USER_REG);
+	TraceBuffer->header = header;
+	if (!header)
+	{
+		os_free(TraceBuffer, sizeof(struct trace_buffer_info));
 		return -ENOMEM;
+	}
+
+	header->size = size;
+	header->ring_size = TraceBuffer->ring_size;
+	header->num_pages = TraceBuffer->num_pages;
+	header->num_cpus = TraceBuffer->num_cpus;
+	for (u32 cpu = 0; cpu < TraceBuffer->num_cpus; cpu++)
+	{
+		header->idx[cpu].head = 0;
+		header->idx[cpu].tail = 0;
+		header->idx[cpu].lock = 0;
+		header->idx[cpu].stamp = 0;
+		header->idx[cpu].last = TRACE_NO_RECORD;
+		header->idx[cpu].last_len = 0;
+		TraceBuffer->rings[cpu].idx = &header->idx[cpu];
+	}
+
+	// pages need not be contiguous; each ring is addressed through its list
+	for (u32 cpu = 0; cpu < TraceBuffer->num_cpus; cpu++)
+	{
+		char **pages = (char **)os_alloc(TraceBuffer->num_pages * sizeof(char *));
+		if (!pages)
+		{
+			free_trace_pages(TraceBuffer);
+			os_free(TraceBuffer, sizeof(struct trace_buffer_info));
+			return -ENOMEM;
+		}
 
-	TraceBuffer->reader = 0;
-	TraceBuffer->writer = 0;
-	TraceBuffer->isFull = 0;
+		for (u32 i = 0; i < TraceBuffer->num_pages; i++)
+			pages[i] = NULL;
+		TraceBuffer->rings[cpu].pages = pages;
+
+		for (u32 i = 0; i < TraceBuffer->num_pages; i++)
+		{
+			pages[i] = (char *)os_page_alloc(USER_REG);
+			if (!pages[i])
+			{
+				free_trace_pages(TraceBuffer);
+				os_free(TraceBuffer, sizeof(struct trace_buffer_info));
+				return -ENOMEM;
+			}
+		}
+	}
 
 	struct fileops *FileOps = (struct fileops *)os_alloc(sizeof(struct fileops));
 	if (!FileOps)
+	{
+		free_trace_pages(TraceBuffer);
+		os_free(TraceBuffer, sizeof(struct trace_buffer_info));
 		return -ENOMEM;
+	}
 
 	struct file *filep = (struct file *)os_page_alloc(USER_REG);
 	if (!filep)
+	{
+		os_free(FileOps, sizeof(struct fileops));
+		free_trace_pages(TraceBuffer);
+		os_free(TraceBuffer, sizeof(struct trace_buffer_info));
 		return -ENOMEM;
+	}
 
 	filep->offp = 0;
 	filep->ref_count = 1;
@@ -217,77 +486,198 @@ int sys_create_trace_buffer(struct exec_context *current, int mode)
 	current->files[fd] = filep;
 	return fd;
 }
-///////////////////////////////////////////////////////////////////////////
-////		Added Functions					//////////////////////////////
-//////////////////////////////////////////////////////////////////////////
 
-int TraceBufferReader(struct file *filep, char *buff, u32 count)
+// Zero-copy reading. sys_map_trace_buffer maps the buffer read-only into
+// the caller: the header page first, then each CPU's ring in CPU order,
+// num_pages pages apiece (ring cpu starts at page 1 + cpu * num_pages).
+// A reader loads head from the header with acquire ordering, consumes the
+// records between its tail and head in place (a trace_record header, then
+// len bytes of payload, both wrapping at ring_size), and hands the space
+// back with sys_advance_trace_buffer. While the buffer is mapped, records
+// are never grown after they are published. The producer only ever needs tail, so
+// nothing else has to be published. Advancing by anything but whole
+// records leaves the ring misaligned for read() and the next reader.
+static inline void invlpg(u64 addr)
 {
-	u32 tb_writer = filep->trace_buffer->writer;
-	u32 tb_reader = filep->trace_buffer->reader;
-	char *tb_buff = filep->trace_buffer->buffer;
-	u32 max_bytes = count;
-
-	int diff = tb_writer - tb_reader;
-	if ((diff == 0 && filep->trace_buffer->isFull == 1) || diff < 0)
-		diff += TRACE_BUFFER_MAX_SIZE;
-	if (max_bytes > diff)
-		max_bytes = diff;
-	if (filep->trace_buffer->isFull == 0 && diff == 0)
-		max_bytes = 0;
-	if (max_bytes == 0)
-		return 0;
+	asm volatile("invlpg (%0)" ::"r"(addr) : "memory");
+}
+
+// Walks the page table to the PTE of addr, allocating missing levels when
+// alloc is set; NULL if a level is missing (or cannot be allocated).
+static u64 *trace_pte(struct exec_context *current, u64 addr, int alloc)
+{
+	u64 *table = (u64 *)osmap(current->pgd);
 
-	for (int i = 0; i < max_bytes; i++)
+	for (int shift = 39; shift > 12; shift -= 9)
 	{
-		buff[i] = tb_buff[tb_reader];
-		tb_reader++;
-		tb_reader %= TRACE_BUFFER_MAX_SIZE;
+		u64 *entry = table + ((addr >> shift) & 0x1FF);
+		if (!(*entry & 0x1))
+		{
+			if (!alloc)
+				return NULL;
+			u64 pfn = (u64)os_pfn_alloc(OS_PT_REG);
+			if (!pfn)
+				return NULL;
+			*entry = (pfn << 12) | 0x19;
+		}
+		table = (u64 *)osmap(*entry >> 12);
 	}
-	filep->trace_buffer->reader = tb_reader;
-	filep->offp = tb_reader;
-	filep->trace_buffer->isFull = 0;
+	return table + ((addr >> 12) & 0x1FF);
+}
 
-	return max_bytes;
+// Kernel address of page i of the mapping. Buffer pages come from the
+// identity-mapped kernel region, so a page's pfn is its address shifted down.
+static char *trace_map_page(struct trace_buffer_info *tb, u32 i)
+{
+	if (i == 0)
+		return (char *)tb->header;
+	i--;
+	return tb->rings[i / tb->num_pages].pages[i % tb->num_pages];
 }
 
-int TraceBufferWriter(struct file *filep, char *buff, u32 count)
+// Undoes sys_map_trace_buffer. PTEs the reader has since unmapped or
+// replaced are left alone, as is the vm_area if it no longer matches.
+static void trace_unmap(struct exec_context *current, struct trace_buffer_info *tb)
 {
-	if (filep == NULL)
+	u32 num_pages = 1 + tb->num_cpus * tb->num_pages;
+	u64 start = tb->map_start;
+	u64 end = start + ((u64)num_pages << TRACE_BUFFER_PAGE_SHIFT);
+
+	for (u32 i = 0; i < num_pages; i++)
 	{
-		return -EINVAL;
+		u64 addr = start + ((u64)i << TRACE_BUFFER_PAGE_SHIFT);
+		u64 pfn = (u64)trace_map_page(tb, i) >> TRACE_BUFFER_PAGE_SHIFT;
+		u64 *pte = trace_pte(current, addr, 0);
+		if (!pte || !(*pte & 0x1) || (*pte >> 12) != pfn)
+			continue;
+		put_pfn(pfn);
+		*pte = 0;
+		invlpg(addr);
+	}
+
+	struct vm_area *prev = current->vm_area;
+	while (prev && prev->vm_next)
+	{
+		struct vm_area *vma = prev->vm_next;
+		if (vma->vm_start == start && vma->vm_end == end && vma->access_flags == PROT_READ)
+		{
+			prev->vm_next = vma->vm_next;
+			os_free(vma, sizeof(struct vm_area));
+			stats->num_vm_area--;
+			break;
+		}
+		prev = vma;
 	}
+	tb->map_start = 0;
+}
+
+static struct trace_buffer_info *trace_buffer_of(struct exec_context *current, int fd)
+{
+	if (!current || fd < 0 || fd >= MAX_OPEN_FILES)
+		return NULL;
+	struct file *filep = current->files[fd];
+	if (!filep || filep->type != TRACE_BUFFER || filep->mode == O_WRITE)
+		return NULL;
+	return filep->trace_buffer;
+}
+
+// Returns the user address of the mapping described above.
+long sys_map_trace_buffer(struct exec_context *current, int fd)
+{
+	struct trace_buffer_info *tb = trace_buffer_of(current, fd);
+	if (!tb || tb->map_start)
+		return -EINVAL;
 
-	u32 tb_writer = filep->trace_buffer->writer;
-	u32 tb_reader = filep->trace_buffer->reader;
-	char *tb_buff = filep->trace_buffer->buffer;
-	u32 max_bytes = count;
+	struct vm_area *VMA_Head = current->vm_area;
+	if (!VMA_Head)
+	{
+		VMA_Head = (struct vm_area *)os_alloc(sizeof(struct vm_area));
+		if (!VMA_Head)
+			return -ENOMEM;
+		VMA_Head->vm_start = MMAP_AREA_START;
+		VMA_Head->vm_end = MMAP_AREA_START + 4096;
+		VMA_Head->vm_next = NULL;
+		VMA_Head->access_flags = 0;
+		current->vm_area = VMA_Head;
+		stats->num_vm_area = 1;
+	}
 
-	int diff = tb_reader - tb_writer;
-	if ((diff == 0 && filep->trace_buffer->isFull == 0) || diff < 0)
-		diff += TRACE_BUFFER_MAX_SIZE;
-	if (max_bytes > diff)
-		max_bytes = diff;
-	if (filep->trace_buffer->isFull == 1)
-		max_bytes = 0; // sanity check
+	// first gap after the dummy head that fits the whole buffer
+	u32 num_pages = 1 + tb->num_cpus * tb->num_pages;
+	u64 length = (u64)num_pages << TRACE_BUFFER_PAGE_SHIFT;
+	struct vm_area *prev = VMA_Head;
+	while (prev->vm_next && prev->vm_next->vm_start - prev->vm_end < length)
+		prev = prev->vm_next;
+	u64 start = prev->vm_end;
+	if (start + length > MMAP_AREA_END)
+		return -ENOMEM;
 
-	if (max_bytes == 0)
-		return 0;
+	struct vm_area *vma = (struct vm_area *)os_alloc(sizeof(struct vm_area));
+	if (!vma)
+		return -ENOMEM;
+	vma->vm_start = start;
+	vma->vm_end = start + length;
+	vma->access_flags = PROT_READ;
+	vma->vm_next = prev->vm_next;
+	prev->vm_next = vma;
+	stats->num_vm_area++;
+	tb->map_start = start;
+	tb->map_pid = current->pid;
+
+	// a write that missed map_start has finished once its ring's lock is
+	// free, so no record grows under the mapped reader from here on
+	for (u32 cpu = 0; cpu < tb->num_cpus; cpu++)
+	{
+		trace_lock(tb->rings[cpu].idx);
+		trace_unlock(tb->rings[cpu].idx);
+	}
 
-	for (int i = 0; i < max_bytes; i++)
+	// present and user, never writable; the extra reference keeps a
+	// reader's munmap from handing the pages back to the allocator
+	for (u32 i = 0; i < num_pages; i++)
 	{
-		tb_buff[tb_writer] = buff[i];
-		tb_writer++;
-		tb_writer %= TRACE_BUFFER_MAX_SIZE;
+		u64 addr = start + ((u64)i << TRACE_BUFFER_PAGE_SHIFT);
+		u64 *pte = trace_pte(current, addr, 1);
+		if (!pte)
+		{
+			trace_unmap(current, tb);
+			return -ENOMEM;
+		}
+
+		u64 pfn = (u64)trace_map_page(tb, i) >> TRACE_BUFFER_PAGE_SHIFT;
+		get_pfn(pfn);
+		*pte = (pfn << 12) | 0x11;
+		invlpg(addr);
 	}
 
-	filep->trace_buffer->writer = tb_writer;
-	filep->offp = tb_writer;
-	if (tb_reader == tb_writer)
-		filep->trace_buffer->isFull = 1;
+	return start;
+}
+
+// Releases count bytes at the tail of cpu's ring on behalf of a mapped
+// reader. Refused while read() is part-way through a record in that ring.
+int sys_advance_trace_buffer(struct exec_context *current, int fd, int cpu, u32 count)
+{
+	struct trace_buffer_info *tb = trace_buffer_of(current, fd);
+	if (!tb || cpu < 0 || cpu >= (int)tb->num_cpus || tb->cur_cpu == cpu)
+		return -EINVAL;
+
+	// under the lock, like a read() claiming a header
+	struct trace_index *idx = tb->rings[cpu].idx;
+	trace_lock(idx);
+	u64 tail = idx->tail;
+	if (count > __atomic_load_n(&idx->head, __ATOMIC_ACQUIRE) - tail)
+	{
+		trace_unlock(idx);
+		return -EINVAL;
+	}
 
-	return max_bytes;
+	__atomic_store_n(&idx->tail, tail + count, __ATOMIC_RELEASE);
+	trace_unlock(idx);
+	return 0;
 }
+///////////////////////////////////////////////////////////////////////////
+////		Added Functions					//////////////////////////////
+//////////////////////////////////////////////////////////////////////////
 
 int get_args(u64 syscall_number)
 {
@@ -380,16 +770,16 @@ int perform_tracing(u64 syscall_num, u64 param1, u64 param2, u64 param3, u64 par
 			return 0;
 	}
 
-	int val = TraceBufferWriter(filep, (char *)&syscall_num, 8);
+	// publish the whole record at once, so a reader draining the buffer
+	// from another CPU never sees a syscall number without its arguments
+	u64 record[5] = {syscall_num, param1, param2, param3, param4};
+	int nargs = get_args(syscall_num);
+	if (nargs < 0)
+		nargs = 0;
+	if (nargs > 4)
+		nargs = 4;
 
-	if (get_args(syscall_num) > 0)
-		TraceBufferWriter(filep, (char *)&param1, 8);
-	if (get_args(syscall_num) > 1)
-		TraceBufferWriter(filep, (char *)&param2, 8);
-	if (get_args(syscall_num) > 2)
-		TraceBufferWriter(filep, (char *)&param3, 8);
-	if (get_args(syscall_num) > 3)
-		TraceBufferWriter(filep, (char *)&param4, 8);
+	TraceBufferWriter(filep, (char *)record, 8 * (nargs + 1));
 
 	return 0;
 }
@@ -839,19 +1229,16 @@ long handle_ftrace_fault(struct user_regs *regs)
 
 	struct file *filep = current->files[FtraceInfo->fd];
 
-	TraceBufferWriter(filep, (char *)&(FtraceInfo->faddr), 8);
-	if (FtraceInfo->num_args > 0)
-		TraceBufferWriter(filep, (char *)&regs->rdi, 8);
-	if (FtraceInfo->num_args > 1)
-		TraceBufferWriter(filep, (char *)&regs->rsi, 8);
-	if (FtraceInfo->num_args > 2)
-		TraceBufferWriter(filep, (char *)&regs->rdx, 8);
-	if (FtraceInfo->num_args > 3)
-		TraceBufferWriter(filep, (char *)&regs->rcx, 8);
-	if (FtraceInfo->num_args > 4)
-		TraceBufferWriter(filep, (char *)&regs->r8, 8);
-	if (FtraceInfo->num_args > 5)
-		TraceBufferWriter(filep, (char *)&regs->r9, 8);
+	// the event is gathered and written as one record, so events traced on
+	// different CPUs never interleave in the merged stream; only a very
+	// deep backtrace is split over several records
+	u64 record[FTRACE_RECORD_MAX];
+	u64 args[6] = {regs->rdi, regs->rsi, regs->rdx, regs->rcx, regs->r8, regs->r9};
+	int len = 0;
+
+	record[len++] = FtraceInfo->faddr;
+	for (int i = 0; i < FtraceInfo->num_args && i < 6; i++)
+		record[len++] = args[i];
 
 	regs->entry_rsp -= 8;
 	*((u64 *)regs->entry_rsp) = regs->rbp;
@@ -864,12 +1251,24 @@ long handle_ftrace_fault(struct user_regs *regs)
 		u64 return_address = FtraceInfo->faddr;
 		while (return_address != END_ADDR)
 		{
-			TraceBufferWriter(filep, (char *)&return_address, 8);
+			if (len == FTRACE_RECORD_MAX)
+			{
+				TraceBufferWriter(filep, (char *)record, 8 * len);
+				len = 0;
+			}
+			record[len++] = return_address;
 			return_address = ((u64 *)((u64)rbp + 8))[0];
 			rbp = (u64 *)(*rbp);
 		}
 	}
-	TraceBufferWriter(filep, (char *)(&DELIMITER), 8);
+
+	if (len == FTRACE_RECORD_MAX)
+	{
+		TraceBufferWriter(filep, (char *)record, 8 * len);
+		len = 0;
+	}
+	record[len++] = DELIMITER;
+	TraceBufferWriter(filep, (char *)record, 8 * len);
 	return 0;
 }
 
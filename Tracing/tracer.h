@@ -8,18 +8,110 @@
 ///////////////////////////////////////////////////////////////////////
 ///////////////////// Trace buffer functionality /////////////////////
 /////////////////////////////////////////////////////////////////////
-#define TRACE_BUFFER_MAX_SIZE 4096
+#define TRACE_BUFFER_PAGE_SIZE 4096
+#define TRACE_BUFFER_PAGE_SHIFT 12
+#define TRACE_BUFFER_MAX_PAGES 256
+// Ring sizes are powers of two in this range; 0 at creation picks the default
+#define TRACE_BUFFER_MIN_SIZE 64
+#define TRACE_BUFFER_MAX_SIZE (TRACE_BUFFER_PAGE_SIZE * TRACE_BUFFER_MAX_PAGES)
+#define TRACE_BUFFER_DEFAULT_SIZE TRACE_BUFFER_PAGE_SIZE
+// The trace buffer syscall takes only a mode. A caller wanting another
+// size ors TRACE_BUFFER_SIZE_SHIFT(log2 of the size) into it; without one,
+// the default size is used.
+#define TRACE_BUFFER_MODE_MASK 0xFF
+#define TRACE_BUFFER_SHIFT_BITS 8
+#define TRACE_BUFFER_SIZE_SHIFT(shift) ((shift) << TRACE_BUFFER_SHIFT_BITS)
+
+#define TRACE_CACHE_LINE 64
+#define TRACE_MAX_CPUS 4
+
+// CPUs a buffer gets a ring for. gemOS brings up a single CPU and keeps no
+// per-CPU state, so by default there is one ring and every writer is CPU
+// 0. A kernel running on more CPUs defines TRACE_NR_CPUS (at most
+// TRACE_MAX_CPUS) and provides trace_this_cpu() from its per-CPU data.
+#ifndef TRACE_NR_CPUS
+#define TRACE_NR_CPUS 1
+#endif
+#if TRACE_NR_CPUS > TRACE_MAX_CPUS
+#error "TRACE_NR_CPUS exceeds TRACE_MAX_CPUS"
+#endif
+#if TRACE_NR_CPUS > 1
+extern u32 trace_this_cpu(void);
+#endif
+
+// Producer and consumer counters of one CPU's ring. head counts every
+// byte ever written and is stored only by the producer holding lock; tail
+// counts every byte consumed and is stored only by the reader (the only
+// consumer), which takes the lock only to claim a record header. Both run
+// freely (the ring position is the count modulo ring_size), so head - tail
+// is the fill level. The lock is normally uncontended, taken only by the
+// ring's own CPU; it covers a writer that moves to another CPU between
+// reading its id and writing. last and last_len describe the newest record
+// a user write may still extend (see trace_append). The producer's fields
+// and tail each sit on their own cache line.
+#define TRACE_NO_RECORD (~0UL)
+struct trace_index
+{
+	u64 head __attribute__((aligned(TRACE_CACHE_LINE)));
+	u32 lock;
+	u32 last_len;	// payload bytes of the record at last
+	u64 stamp;		// latest record timestamp, never decreases
+	u64 last;		// position of that record, or TRACE_NO_RECORD
+	u64 tail __attribute__((aligned(TRACE_CACHE_LINE)));
+};
+
+// First page of a trace buffer. It holds every ring's counters and the
+// geometry a user-space reader needs once the buffer is mapped (see
+// sys_map_trace_buffer); the kernel works on it through the same pointer.
+struct trace_header
+{
+	struct trace_index idx[TRACE_MAX_CPUS];
+	u32 size;		// payload bytes per ring
+	u32 ring_size;	// bytes per ring, where positions wrap
+	u32 num_pages;	// pages per ring
+	u32 num_cpus;
+};
+
+// One CPU's ring, backed by a list of separately allocated pages.
+struct trace_ring
+{
+	struct trace_index *idx;
+	char **pages;
+};
+
+// A record in the writing CPU's ring: this header, then len bytes of
+// payload. An in-kernel write is always a record of its own; a user write
+// may instead grow the ring's newest user record (see trace_append).
+struct trace_record
+{
+	u64 tsc;
+	u32 len;
+	u32 cpu;
+};
 
-// Trace buffer information structure
+// Trace buffer information structure. Reads merge the per-CPU rings by
+// timestamp; a record may be handed out over several reads, and cur_cpu
+// and cur_left (consumer-only) track the one in progress. map_start is the
+// user address of the read-only mapping, 0 if there is none, and map_pid
+// the process whose page table holds it.
 struct trace_buffer_info
 {
-	u32 reader;
-	u32 writer;
-	char *buffer;
-	int isFull;
+	struct trace_header *header;
+	struct trace_ring rings[TRACE_MAX_CPUS];
+	u32 size;		// payload bytes per ring
+	u32 ring_size;	// size plus one record header
+	u32 num_pages;	// pages per ring
+	u32 num_cpus;	// rings in use, TRACE_NR_CPUS
+	int cur_cpu;
+	u32 cur_left;
+	u64 map_start;
+	u32 map_pid;
 };
 
 extern int sys_create_trace_buffer(struct exec_context *current, int mode);
+extern int sys_create_sized_trace_buffer(struct exec_context *current, int mode, u32 size);
+extern long sys_map_trace_buffer(struct exec_context *current, int fd);
+extern int sys_advance_trace_buffer(struct exec_context *current, int fd, int cpu, u32 count);
 extern void free_trace_buffer_info(struct trace_buffer_info *p_info);
 
 ///////////////////////////////////////////////////////////////////////
@@ -67,6 +159,8 @@ extern int perform_tracing(u64 syscall, u64 param1, u64 param2, u64 param3, u64
 ///////////////////////////////////////////////////////////////////////
 
 #define FTRACE_MAX 16
+// u64 slots gathered per ftrace record before it is written out
+#define FTRACE_RECORD_MAX 64
 #define MAX_ARGS 5
 #define PUSH_RBP_OPCODE 0x55
 #define INV_OPCODE 0xFF